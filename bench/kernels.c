@@ -0,0 +1,88 @@
+// Element-wise kernels against a naive loop that dispatches on the operator for every
+// item, the way a per-element interpreter would. Runs `dst = a op b` in place for each
+// size and prints the best time in ms for the loop and for every instruction set the CPU
+// has. The largest size defaults to 1e8 (1.6GB of operands); pass another as argv[1].
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "kernels.h"
+
+
+static double now_ms() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+__attribute__((noinline)) static double naive_item(Vnl_KernelOp op, double x, double y) {
+	switch (op) {
+		case VNL_KERNEL_ADD: return x + y;
+		case VNL_KERNEL_SUB: return x - y;
+		case VNL_KERNEL_MUL: return x * y;
+		case VNL_KERNEL_DIV: return x / y;
+		case VNL_KERNEL_MOD: break;
+	}
+	return 0;
+}
+
+__attribute__((noinline)) static void naive_vv(Vnl_KernelOp op, double *dst, const double *a, const double *b, size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		dst[i] = naive_item(op, a[i], b[i]);
+	}
+}
+
+// Fewer repetitions for larger sizes keep every row to a few seconds.
+static size_t reps_for(size_t n) {
+	return n <= 10000 ? 2000 : n <= 1000000 ? 50 : n <= 10000000 ? 10 : 3;
+}
+
+static void bench(Vnl_KernelOp op, const char *name, size_t n) {
+	double *a = malloc(sizeof(*a) * n);
+	double *b = malloc(sizeof(*b) * n);
+	if (!a || !b) {
+		printf("%s n=%zu: out of memory\n", name, n);
+		free(a);
+		free(b);
+		return;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		a[i] = i * 0.5 + 1;
+		b[i] = 1.0000001;
+	}
+
+	double best = 1e30;
+	for (size_t r = 0; r < reps_for(n); ++r) {
+		double start = now_ms();
+		naive_vv(op, a, a, b, n);
+		double ms = now_ms() - start;
+		best = ms < best ? ms : best;
+	}
+	printf("%s n=%-10zu naive %9.3f", name, n, best);
+
+	Vnl_KernelIsa supported = vnl_kernel_isa();
+	for (Vnl_KernelIsa isa = VNL_ISA_SCALAR; isa <= supported; ++isa) {
+		best = 1e30;
+		for (size_t r = 0; r < reps_for(n); ++r) {
+			double start = now_ms();
+			vnl_kernel_vv(isa, op, a, a, b, n);
+			double ms = now_ms() - start;
+			best = ms < best ? ms : best;
+		}
+		printf("  %s %9.3f", vnl_kernel_isa_name(isa), best);
+	}
+	printf("\n");
+	free(a);
+	free(b);
+}
+
+int main(int argc, char **argv) {
+	size_t max = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000000;
+	for (size_t n = 10000; n <= max; n *= 10) {
+		bench(VNL_KERNEL_MUL, "mul", n);
+	}
+	for (size_t n = 10000; n <= max; n *= 10) {
+		bench(VNL_KERNEL_DIV, "div", n);
+	}
+	return 0;
+}
@@ -0,0 +1,92 @@
+
+#include "arena.h"
+#include "common.h"
+#include <stdalign.h>
+#include <stddef.h>
+#include <string.h>
+
+
+struct Vnl_ArenaChunk {
+	Vnl_ArenaChunk *next;
+	size_t cap;
+	size_t used;
+	alignas(max_align_t) unsigned char data[];
+};
+
+static const size_t CHUNK_SIZE = 64 * 1024;
+
+
+static size_t align_up(size_t x) {
+	const size_t align = alignof(max_align_t);
+	return (x + (align - 1)) & ~(align - 1);
+}
+
+static Vnl_ArenaChunk *vnl_arena_new_chunk(size_t cap) {
+	Vnl_ArenaChunk *chunk = vnl_malloc(sizeof(*chunk) + cap);
+	chunk->cap = cap;
+	return chunk;
+}
+
+
+// Chunks are kept across resets, so a steady-state workload stops allocating once the
+// chain is long enough. Chunks past `curr` are stale and get rewound when entered.
+void *vnl_arena_alloc(Vnl_Arena *self, size_t size) {
+	size = align_up(size);
+
+	if (self->curr == nullptr) {
+		self->head = self->curr = vnl_arena_new_chunk(size > CHUNK_SIZE ? size : CHUNK_SIZE);
+	}
+
+	while (self->curr->used + size > self->curr->cap) {
+		Vnl_ArenaChunk *next = self->curr->next;
+		if (next == nullptr || next->cap < size) {
+			Vnl_ArenaChunk *chunk = vnl_arena_new_chunk(size > CHUNK_SIZE ? size : CHUNK_SIZE);
+			chunk->next = next;
+			self->curr->next = chunk;
+			next = chunk;
+		}
+		next->used = 0;
+		self->curr = next;
+	}
+
+	void *ptr = self->curr->data + self->curr->used;
+	self->curr->used += size;
+	return ptr;
+}
+
+void *vnl_arena_realloc(Vnl_Arena *self, void *ptr, size_t old_size, size_t new_size) {
+	if (ptr == nullptr) {
+		return vnl_arena_alloc(self, new_size);
+	}
+
+	// The last allocation of the current chunk can be grown in place.
+	Vnl_ArenaChunk *chunk = self->curr;
+	size_t old_aligned = align_up(old_size);
+	size_t new_aligned = align_up(new_size);
+	if ((unsigned char *)ptr + old_aligned == chunk->data + chunk->used
+	    && chunk->used - old_aligned + new_aligned <= chunk->cap) {
+		chunk->used = chunk->used - old_aligned + new_aligned;
+		return ptr;
+	}
+
+	void *new_ptr = vnl_arena_alloc(self, new_size);
+	memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+	return new_ptr;
+}
+
+void vnl_arena_reset(Vnl_Arena *self) {
+	if (self->head) {
+		self->head->used = 0;
+	}
+	self->curr = self->head;
+}
+
+void vnl_arena_free(Vnl_Arena *self) {
+	Vnl_ArenaChunk *chunk = self->head;
+	while (chunk) {
+		Vnl_ArenaChunk *next = chunk->next;
+		vnl_free(chunk);
+		chunk = next;
+	}
+	self->head = self->curr = nullptr;
+}
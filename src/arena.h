@@ -0,0 +1,22 @@
+#ifndef __VINYL_ARENA_H__
+#define __VINYL_ARENA_H__
+
+#include <stddef.h>
+
+
+typedef struct Vnl_Arena Vnl_Arena;
+typedef struct Vnl_ArenaChunk Vnl_ArenaChunk;
+
+struct Vnl_Arena {
+	Vnl_ArenaChunk *head;
+	Vnl_ArenaChunk *curr;
+};
+
+
+void *vnl_arena_alloc(Vnl_Arena *, size_t);
+void *vnl_arena_realloc(Vnl_Arena *, void *, size_t, size_t);
+void vnl_arena_reset(Vnl_Arena *);
+void vnl_arena_free(Vnl_Arena *);
+
+
+#endif // __VINYL_ARENA_H__
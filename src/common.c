@@ -1,5 +1,7 @@
 
 #include "common.h"
+#include <assert.h>
+#include <stdalign.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -7,14 +9,70 @@
 #include <string.h>
 
 
+typedef struct Vnl_AllocHeader Vnl_AllocHeader;
+
+// Prepended to every vnl_malloc block; 16 bytes, so user pointers keep malloc's alignment.
+struct Vnl_AllocHeader {
+	Vnl_Heap *heap;
+	size_t size;
+};
+
+static_assert(sizeof(Vnl_AllocHeader) % alignof(max_align_t) == 0, "allocation header breaks alignment");
+
+static _Thread_local Vnl_Heap *CURRENT_HEAP = nullptr;
+
+
+Vnl_Heap *vnl_heap_enter(Vnl_Heap *heap) {
+	Vnl_Heap *prev = CURRENT_HEAP;
+	CURRENT_HEAP = heap;
+	return prev;
+}
+
+void vnl_heap_leave(Vnl_Heap *prev) {
+	CURRENT_HEAP = prev;
+}
+
+Vnl_Heap *vnl_heap_current() {
+	return CURRENT_HEAP;
+}
+
+void vnl_heap_charge(Vnl_Heap *heap, size_t size) {
+	if (heap == nullptr) {
+		return;
+	}
+	heap->live_bytes += size;
+	heap->allocations++;
+	if (heap->live_bytes > heap->peak_bytes) {
+		heap->peak_bytes = heap->live_bytes;
+	}
+	if (heap->limit && heap->live_bytes > heap->limit) {
+		heap->exceeded = true;
+	}
+}
+
+void vnl_heap_discharge(Vnl_Heap *heap, size_t size) {
+	if (heap == nullptr) {
+		return;
+	}
+	heap->live_bytes -= size;
+	heap->frees++;
+}
+
+bool vnl_heap_would_exceed(const Vnl_Heap *heap, size_t size) {
+	return heap && heap->limit && size > heap->limit - (heap->live_bytes < heap->limit ? heap->live_bytes : heap->limit);
+}
+
+
 void *vnl_malloc(size_t size) {
-	void *ptr = malloc(size);
-	if (ptr == nullptr) {
+	Vnl_AllocHeader *hdr = malloc(sizeof(*hdr) + size);
+	if (hdr == nullptr) {
 		printf(VNL_ANSICOL_RED "Fatal error: unable to malloc!" VNL_ANSICOL_RESET);
 		abort();
 	}
-	memset(ptr, 0, size);
-	return ptr;
+	memset(hdr + 1, 0, size);
+	*hdr = (Vnl_AllocHeader){ CURRENT_HEAP, size };
+	vnl_heap_charge(hdr->heap, size);
+	return hdr + 1;
 }
 
 
@@ -23,13 +81,22 @@ void *vnl_realloc(void *ptr, size_t new_size) {
 		vnl_free(ptr);
 		return nullptr;
 	}
-	void *new_ptr = realloc(ptr, new_size);
-	if (new_ptr == nullptr) {
-		free(ptr);
+	if (ptr == nullptr) {
+		return vnl_malloc(new_size);
+	}
+	Vnl_AllocHeader *hdr = (Vnl_AllocHeader *)ptr - 1;
+	Vnl_Heap *heap = hdr->heap;
+	size_t old_size = hdr->size;
+	Vnl_AllocHeader *new_hdr = realloc(hdr, sizeof(*hdr) + new_size);
+	if (new_hdr == nullptr) {
+		free(hdr);
 		printf(VNL_ANSICOL_RED "Fatal error: Unable to realloc!" VNL_ANSICOL_RESET);
 		abort();
 	}
-	return new_ptr;
+	new_hdr->size = new_size;
+	vnl_heap_discharge(heap, old_size);
+	vnl_heap_charge(heap, new_size);
+	return new_hdr + 1;
 }
 
 
@@ -37,7 +104,9 @@ void vnl_free(void *ptr) {
 	if (ptr == nullptr) {
 		return;
 	}
-	free(ptr);
+	Vnl_AllocHeader *hdr = (Vnl_AllocHeader *)ptr - 1;
+	vnl_heap_discharge(hdr->heap, hdr->size);
+	free(hdr);
 }
 
 bool vnl_memcmpeq(const void *mema, const void *memb, size_t size) {
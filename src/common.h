@@ -16,11 +16,36 @@
 #define VNL_ANSICOL_CYAN    "\e[36m"
 #define VNL_ANSICOL_WHITE   "\e[37m"
 
+#define VNL_HEAP_OBJTYPES 8
+
+
+typedef struct Vnl_Heap Vnl_Heap;
+
+// Allocation accounting. Every block from vnl_malloc/vnl_realloc is charged to the heap
+// that was current when it was first allocated, and credited back to it when freed.
+// `limit` is soft: crossing it only raises `exceeded`, which the executor polls.
+struct Vnl_Heap {
+	size_t live_bytes;
+	size_t peak_bytes;
+	size_t allocations;
+	size_t frees;
+	size_t objects_by_type[VNL_HEAP_OBJTYPES];
+	size_t limit;
+	bool exceeded;
+};
+
 
 void *vnl_malloc(size_t);
 void *vnl_realloc(void *, size_t);
 void vnl_free(void *);
 
+Vnl_Heap *vnl_heap_enter(Vnl_Heap *);
+void vnl_heap_leave(Vnl_Heap *);
+Vnl_Heap *vnl_heap_current();
+void vnl_heap_charge(Vnl_Heap *, size_t);
+void vnl_heap_discharge(Vnl_Heap *, size_t);
+bool vnl_heap_would_exceed(const Vnl_Heap *, size_t);
+
 bool vnl_memcmpeq(const void *, const void *, size_t);
 
 #endif // __VINYL_COMMON__
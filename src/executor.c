@@ -1,22 +1,35 @@
 
 #include <ctype.h>
+#include <inttypes.h>
 #include <math.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 #include <ctype.h>
 
+#include "arena.h"
 #include "executor.h"
+#include "intern.h"
+#include "jit.h"
+#include "kernels.h"
 #include "object.h"
-#include "strmap.h"
+#include "pool.h"
+#include "threadpool.h"
+#include "vartable.h"
 #include "common.h"
 #include "string.h"
 
+#include <xxhash.h>
+
 
 typedef struct Vnl_Token Vnl_Token;
 typedef struct Vnl_Stack Vnl_Stack;
+typedef struct CompileCache CompileCache;
 
 struct Vnl_Token {
     enum {
@@ -28,25 +41,43 @@ struct Vnl_Token {
         TOK_LBRACK,
         TOK_RBRACK,
         TOK_COMMA,
+        TOK_COLON,
         TOK_OP,
         TOK_EOF,
     } type;
     union {
         Vnl_String value;
         double numval;
+        const Vnl_Symbol *symbol;
     };
 };
 
+// The VM stack is reserved once, with an inaccessible guard page after it. Code checks
+// its compiler-computed maximum depth against `cap` before it starts, so pushes and pops
+// don't check anything; an overflow that slips past that hits the guard page.
 struct Vnl_Stack {
-	Vnl_Object **stack;
+	Vnl_Value *stack;
 	size_t len;
 	size_t cap;
+	size_t mapped;
 };
 
 struct Vnl_Executor {
 	Vnl_Stack stack;
-    Vnl_StringMap *varlist;
-    Vnl_Object *error;
+    Vnl_Arena arena;
+    Vnl_VarTable *vars;
+    Vnl_ObjectPool *pool;
+    size_t free_budget;
+    Vnl_Value error;
+    Vnl_Heap heap;
+    CompileCache *cache;
+    Vnl_Value *regs;
+    size_t regs_cap;
+    bool jit;
+    bool jit_verify;
+    Vnl_KernelIsa simd;
+    size_t threads;
+    size_t parallel_threshold;
 };
 
 
@@ -61,6 +92,7 @@ static const Vnl_CString TOKTYPE_NAMES[] = {
     [TOK_LBRACK] = "LBrack",
     [TOK_RBRACK] = "RBrack",
     [TOK_COMMA]  = "Comma",
+    [TOK_COLON]  = "Colon",
     [TOK_OP]     = "Operator",
     [TOK_EOF]    = "Eof"
 };
@@ -79,23 +111,21 @@ typedef struct {
 } Tokens;
 
 
-void tokens_push(Tokens *tokens, Vnl_Token token) {
+void tokens_push(Vnl_Arena *arena, Tokens *tokens, Vnl_Token token) {
     if (tokens->cap == tokens->len) {
         size_t newcap = tokens->cap;
         newcap = newcap ? newcap * 2 : 32;
-        tokens->items = realloc(tokens->items, newcap * sizeof(Vnl_Token));
+        tokens->items = vnl_arena_realloc(
+            arena,
+            tokens->items,
+            tokens->cap * sizeof(Vnl_Token),
+            newcap * sizeof(Vnl_Token)
+        );
         tokens->cap = newcap;
     }
     tokens->items[tokens->len++] = token;
 }
 
-void tokens_free(Tokens *tokens) {
-    free(tokens->items);
-    tokens->items = nullptr;
-    tokens->len = 0;
-    tokens->cap = 0;
-}
-
 void token_display(const Vnl_Token *tok) {
     printf("Vnl_Token{");
     printf("type=%s", TOKTYPE_NAMES[tok->type]);
@@ -114,10 +144,15 @@ void token_display(const Vnl_Token *tok) {
         case TOK_LBRACK:
         case TOK_RBRACK:
         case TOK_COMMA:
+        case TOK_COLON:
         case TOK_EOF:
         break;
 
         case TOK_IDENT:
+            printf(", value=");
+            vnl_string_print(vnl_symbol_str(tok->symbol));
+        break;
+
         case TOK_OP:
             printf(", value=");
             vnl_string_print(tok->value);
@@ -144,6 +179,11 @@ typedef enum {
     PARSEERR_AST_EXPECTED_EOF,
     PARSEERR_AST_EXPECTED_LVALUE,
     PARSEERR_AST_EXPECTED_RVALUE,
+    PARSEERR_AST_SUBSCRIPT_ASSIGN,
+
+    // Trees that parse but can't be compiled.
+    PARSEERR_AST_NOT_ASSIGNABLE,
+    PARSEERR_AST_UNSUPPORTED_CALL,
 
     // PARSEERR_AST_UNEXPECTED_IDENT,
     // PARSEERR_AST_UNEXPECTED_NUMLIT,
@@ -159,7 +199,7 @@ typedef enum {
 } ParseError;
 
 
-ParseError tokenize(Vnl_String *source, Tokens *tokens) {
+ParseError tokenize(Vnl_Arena *arena, Vnl_String *source, Tokens *tokens) {
     ParseError err = PARSEERR_OK;
     *source = vnl_string_ltrim(*source);
 
@@ -168,46 +208,53 @@ ParseError tokenize(Vnl_String *source, Tokens *tokens) {
             case '(': {
                 *source = vnl_string_lshift(*source);
                 Vnl_Token tok = { TOK_LPAREN, .value = {0} };
-                tokens_push(tokens, tok);
+                tokens_push(arena, tokens, tok);
             } break;
 
             case ')': {
                 *source = vnl_string_lshift(*source);
                 Vnl_Token tok = { TOK_RPAREN, .value = {0} };
-                tokens_push(tokens, tok);
+                tokens_push(arena, tokens, tok);
             } break;
 
             case '[': {
                 *source = vnl_string_lshift(*source);
                 Vnl_Token tok = { TOK_LBRACK, .value = {0} };
-                tokens_push(tokens, tok);
+                tokens_push(arena, tokens, tok);
             } break;
 
             case ']': {
                 *source = vnl_string_lshift(*source);
                 Vnl_Token tok = { TOK_RBRACK, .value = {0} };
-                tokens_push(tokens, tok);
+                tokens_push(arena, tokens, tok);
             } break;
 
             case ',': {
                 *source = vnl_string_lshift(*source);
                 Vnl_Token tok = { TOK_COMMA, .value = {0} };
-                tokens_push(tokens, tok);
+                tokens_push(arena, tokens, tok);
+            } break;
+
+            case ':': {
+                *source = vnl_string_lshift(*source);
+                Vnl_Token tok = { TOK_COLON, .value = {0} };
+                tokens_push(arena, tokens, tok);
             } break;
 
             case '"': {
                 *source = vnl_string_lshift(*source);
-                Vnl_Token tok = { .type = TOK_STRLIT, .value = {source->chars, 0} };
+                Vnl_String value = { source->chars, 0 };
                 while(source->len && *source->chars != '"') {
                     *source = vnl_string_lshift(*source);
-                    tok.value.len++;
+                    value.len++;
                 }
                 if (!source->len) {
                     err = PARSEERR_AST_UNFINISHED_STRLIT;
                     goto return_err;
                 }
                 *source = vnl_string_lshift(*source);
-                tokens_push(tokens, tok);
+                Vnl_Token tok = { TOK_STRLIT, .value = value };
+                tokens_push(arena, tokens, tok);
             } break;
 
             case '0' ... '9': {
@@ -220,19 +267,19 @@ ParseError tokenize(Vnl_String *source, Tokens *tokens) {
                 }
                 *source = vnl_string_lshiftn(*source, end - start);
                 Vnl_Token tok = { TOK_NUMLIT, .numval = numval };
-                tokens_push(tokens, tok);
+                tokens_push(arena, tokens, tok);
             } break;
 
             case 'a' ... 'z':
             case 'A' ... 'Z':
             case '_': {
-                Vnl_Token tok = { TOK_IDENT, .value = *source };
-                tok.value.len = 0;
+                Vnl_String value = { source->chars, 0 };
                 while (source->len && (isalnum(*source->chars) || *source->chars == '_')) {
-                    tok.value.len ++;
+                    value.len ++;
                     *source = vnl_string_lshift(*source);
                 }
-                tokens_push(tokens, tok);
+                Vnl_Token tok = { TOK_IDENT, .symbol = vnl_intern_s(value) };
+                tokens_push(arena, tokens, tok);
             } break;
 
             case '+': case '-':
@@ -240,7 +287,7 @@ ParseError tokenize(Vnl_String *source, Tokens *tokens) {
             case '%': case '=': {
                 Vnl_Token tok = { TOK_OP, .value = { source->chars, 1 } };
                 *source = vnl_string_lshift(*source);
-                tokens_push(tokens, tok);
+                tokens_push(arena, tokens, tok);
             } break;
 
             default:
@@ -253,11 +300,8 @@ ParseError tokenize(Vnl_String *source, Tokens *tokens) {
         *source = vnl_string_ltrim(*source);
     } // while (source->len)
 
-    return err;
-
     return_err:
-        tokens_free(tokens);
-        return err;
+    return err;
 }
 
 
@@ -296,6 +340,9 @@ typedef enum {
     ASTTYPE_BINOP,
     ASTTYPE_CALL,
     ASTTYPE_ARRAY_LITERAL,
+    ASTTYPE_CONST,
+    ASTTYPE_INDEX,
+    ASTTYPE_SLICE,
 } ASTNodeType;
 
 
@@ -319,12 +366,14 @@ typedef struct {
 
 typedef struct {
     _ASTNODEBASE();
-    Vnl_StringBuffer value;
+    const Vnl_Symbol *value;
 } ASTNode_Ident;
 
+// Points into the statement's source. Literals are not interned: the compilers copy them
+// into the code's constants, so nothing outlives the statement.
 typedef struct {
     _ASTNODEBASE();
-    Vnl_StringBuffer value;
+    Vnl_String value;
 } ASTNode_Strlit;
 
 typedef struct {
@@ -350,18 +399,47 @@ typedef struct {
     ASTNode *rhs;
 } ASTNode_BinOp;
 
+// `target[index]`.
+typedef struct {
+    _ASTNODEBASE();
+    ASTNode *target;
+    ASTNode *index;
+} ASTNode_Index;
+
+// `target[start:stop:step]`. Bounds left out are nullptr.
+typedef struct {
+    _ASTNODEBASE();
+    ASTNode *target;
+    ASTNode *start;
+    ASTNode *stop;
+    ASTNode *step;
+} ASTNode_Slice;
+
+// Produced by constant folding. The node owns a reference to `value` until the subtree is
+// compiled, at which point it is handed over to the code.
+typedef struct {
+    _ASTNODEBASE();
+    Vnl_Value value;
+} ASTNode_Const;
+
 
 typedef struct {
     const Tokens *tokens;
     size_t off;
+    Vnl_Arena *arena;
 } TokenIterator;
 
 
-void arrlit_push(ASTNode_ArrayLiteral *arrlit, ASTNode *node) {
+void arrlit_push(Vnl_Arena *arena, ASTNode_ArrayLiteral *arrlit, ASTNode *node) {
     if (arrlit->cap == arrlit->len) {
         size_t newcap = arrlit->cap;
         newcap = newcap ? newcap * 2 : 4;
-        arrlit->items = realloc(arrlit->items, newcap * sizeof(ASTNode *));
+        arrlit->items = vnl_arena_realloc(
+            arena,
+            arrlit->items,
+            arrlit->cap * sizeof(ASTNode *),
+            newcap * sizeof(ASTNode *)
+        );
         arrlit->cap = newcap;
     }
     arrlit->items[arrlit->len++] = node;
@@ -382,51 +460,6 @@ Vnl_Token titer_peek(const TokenIterator *titer) {
 }
 
 
-void ast_free(ASTNode *node) {
-    switch (node->_ast_type) {
-            case ASTTYPE_NUMLIT: {
-                free(node);
-            } break;
-
-            case ASTTYPE_STRLIT: {
-                ASTNode_Strlit *strlit = (void *)node;
-                vnl_strbuf_free(&strlit->value);
-                free(node);
-            } break;
-
-            case ASTTYPE_IDENT: {
-                ASTNode_Ident *ident = (ASTNode_Ident *)node;
-                vnl_strbuf_free(&ident->value);
-                free(ident);
-            } break;
-
-            case ASTTYPE_BINOP: {
-                ASTNode_BinOp *binop = (void *)node;
-                ast_free(binop->lhs);
-                ast_free(binop->rhs);
-                free(binop);
-            } break;
-
-            case ASTTYPE_CALL: {
-                ASTNode_Call *call = (void *)node;
-                ast_free(call->callee);
-                for (size_t i = 0; i < call->args_len; ++i) {
-                    ast_free(call->args[i]);
-                }
-                free(call);
-            } break;
-
-            case ASTTYPE_ARRAY_LITERAL: {
-                ASTNode_ArrayLiteral *arr = (void *)node;
-                for (size_t i = 0; i < arr->len; ++i) {
-                    ast_free(arr->items[i]);
-                }
-                free(arr);
-            } break;
-    }
-}
-
-
 OpInfo get_op_info(Vnl_String strop) {
     const size_t numops = sizeof(OPINFO_TABLE)/sizeof(OPINFO_TABLE[0]);
     for (size_t i = 0; i < numops; ++i) {
@@ -454,15 +487,14 @@ ParseError parse_array_literal(TokenIterator *titer, ASTNode **node) {
     }
     titer_get(titer);
 
-    ASTNode_ArrayLiteral *arr = vnl_malloc(sizeof(*arr));
+    ASTNode_ArrayLiteral *arr = vnl_arena_alloc(titer->arena, sizeof(*arr));
     *arr = (ASTNode_ArrayLiteral){ { ASTTYPE_ARRAY_LITERAL, RVALUE } };
 
     while (true) {
         ASTNode *item = nullptr;
         err = parse_expression(titer, &item, 0.0);
         if (err) goto return_failure;
-        arrlit_push(arr, item);
-        item = nullptr;
+        arrlit_push(titer->arena, arr, item);
 
         // expect ',' or ']'
         tok = titer_peek(titer);
@@ -478,8 +510,6 @@ ParseError parse_array_literal(TokenIterator *titer, ASTNode **node) {
     }
 
     return_failure:
-        if (arr) ast_free((ASTNode *)arr);
-        if (*node) ast_free(*node);
         return err;
 
     return_success:
@@ -489,10 +519,53 @@ ParseError parse_array_literal(TokenIterator *titer, ASTNode **node) {
 
 
 
+// Parses the `[...]` after an operand: `[index]`, `[start:stop]` or `[start:stop:step]`,
+// where any of the slice bounds can be left out, as in `[:n]` or `[::2]`.
+ParseError parse_subscript(TokenIterator *titer, ASTNode *target, ASTNode **node) {
+    Vnl_Token tok;
+    ParseError err = PARSEERR_OK;
+    *node = nullptr;
+    titer_get(titer);
+
+    ASTNode *bounds[3] = { nullptr, nullptr, nullptr };
+    size_t colons = 0;
+    while (true) {
+        tok = titer_peek(titer);
+        if (tok.type != TOK_COLON && tok.type != TOK_RBRACK) {
+            err = parse_expression(titer, &bounds[colons], 0.0);
+            if (err) return err;
+            tok = titer_peek(titer);
+        }
+        if (tok.type == TOK_RBRACK) {
+            if (colons == 0 && !bounds[0]) {
+                return PARSEERR_AST_EXPECTED_RVALUE;
+            }
+            titer_get(titer);
+            break;
+        }
+        if (tok.type != TOK_COLON || colons == 2) {
+            return PARSEERR_AST_EXPECTED_RBRACK;
+        }
+        titer_get(titer);
+        colons++;
+    }
+
+    if (colons == 0) {
+        ASTNode_Index *index = vnl_arena_alloc(titer->arena, sizeof(*index));
+        *index = (ASTNode_Index){ { ASTTYPE_INDEX, RVALUE }, target, bounds[0] };
+        *node = (ASTNode *)index;
+    } else {
+        ASTNode_Slice *slice = vnl_arena_alloc(titer->arena, sizeof(*slice));
+        *slice = (ASTNode_Slice){ { ASTTYPE_SLICE, RVALUE }, target, bounds[0], bounds[1], bounds[2] };
+        *node = (ASTNode *)slice;
+    }
+    return err;
+}
+
 ParseError parse_expression(TokenIterator *titer, ASTNode **expr, float min_bp) {
     Vnl_Token tok;
     *expr = nullptr;
-    ASTNode *lhs = nullptr, *rhs = nullptr;
+    ASTNode *lhs = nullptr;
     ParseError err = PARSEERR_OK;
 
     tok = titer_peek(titer);
@@ -500,6 +573,7 @@ ParseError parse_expression(TokenIterator *titer, ASTNode **expr, float min_bp)
         case TOK_RPAREN:
         case TOK_RBRACK:
         case TOK_COMMA:
+        case TOK_COLON:
         case TOK_OP:
         case TOK_EOF:
             err = PARSEERR_AST_EXPECTED_LVALUE;
@@ -507,23 +581,21 @@ ParseError parse_expression(TokenIterator *titer, ASTNode **expr, float min_bp)
 
         case TOK_IDENT: {
             titer_get(titer);
-            ASTNode_Ident *ident = vnl_malloc(sizeof(*ident));
-            *ident = (ASTNode_Ident) { { ASTTYPE_IDENT, LVALUE }, (Vnl_StringBuffer){} };
-            vnl_strbuf_append_s(&ident->value, tok.value);
+            ASTNode_Ident *ident = vnl_arena_alloc(titer->arena, sizeof(*ident));
+            *ident = (ASTNode_Ident) { { ASTTYPE_IDENT, LVALUE }, tok.symbol };
             lhs = (void *)ident;
         } break;
 
         case TOK_STRLIT: {
             titer_get(titer);
-            ASTNode_Strlit *strlit = vnl_malloc(sizeof(*strlit));
-            *strlit = (ASTNode_Strlit){ { ASTTYPE_STRLIT, LVALUE }, (Vnl_StringBuffer){} };
-            vnl_strbuf_append_s(&strlit->value, tok.value);
+            ASTNode_Strlit *strlit = vnl_arena_alloc(titer->arena, sizeof(*strlit));
+            *strlit = (ASTNode_Strlit){ { ASTTYPE_STRLIT, LVALUE }, tok.value };
             lhs = (void *)strlit;
         } break;
 
         case TOK_NUMLIT: {
             titer_get(titer);
-            ASTNode_Numlit *numlit = vnl_malloc(sizeof(*numlit));
+            ASTNode_Numlit *numlit = vnl_arena_alloc(titer->arena, sizeof(*numlit));
             *numlit = (ASTNode_Numlit){ {ASTTYPE_NUMLIT, RVALUE }, tok.numval };
             lhs = (void *)numlit;
         } break;
@@ -556,14 +628,20 @@ ParseError parse_expression(TokenIterator *titer, ASTNode **expr, float min_bp)
             case TOK_NUMLIT:
             case TOK_STRLIT:
             case TOK_LPAREN:
-            case TOK_LBRACK:
                 err = PARSEERR_AST_EXPECTED_BINOP;
                 goto return_failure;
 
+            // Subscripts bind tighter than any operator.
+            case TOK_LBRACK:
+                err = parse_subscript(titer, lhs, &lhs);
+                if (err) goto return_failure;
+                continue;
+
             case TOK_EOF:
             case TOK_RPAREN:
             case TOK_RBRACK:
             case TOK_COMMA:
+            case TOK_COLON:
                 *expr = lhs;
                 goto return_success;
 
@@ -578,21 +656,25 @@ ParseError parse_expression(TokenIterator *titer, ASTNode **expr, float min_bp)
             goto return_success;
         }
 
+        // Arrays can't be changed in place: slices share their target's items.
+        if (opinfo.kind == BINOP_SET && (lhs->_ast_type == ASTTYPE_INDEX || lhs->_ast_type == ASTTYPE_SLICE)) {
+            err = PARSEERR_AST_SUBSCRIPT_ASSIGN;
+            goto return_failure;
+        }
+
         titer_get(titer);
 
         ASTNode *rhs = nullptr;
         err = parse_expression(titer, &rhs, opinfo.right_bp);
         if (err) goto return_failure;
 
-        ASTNode_BinOp *binop = vnl_malloc(sizeof(*binop));
+        ASTNode_BinOp *binop = vnl_arena_alloc(titer->arena, sizeof(*binop));
         *binop = (ASTNode_BinOp){ {ASTTYPE_BINOP, RVALUE}, opinfo.kind, lhs, rhs };
         lhs = (ASTNode *)binop;
 
     } // while (true)
 
     return_failure:
-        if (lhs) ast_free(lhs);
-        if (rhs) ast_free(rhs);
         return err;
 
     return_success:
@@ -607,12 +689,13 @@ ParseError parse_statement(TokenIterator *titer, ASTNode **node) {
     if (err) return err;
     Vnl_Token tok = titer_peek(titer);
     if (tok.type != TOK_EOF) {
-        if (*node) ast_free(*node);
         return PARSEERR_AST_EXPECTED_EOF;
     }
     return err;
 }
 
+void value_print(Vnl_Value val);
+
 void _ast_print_impl(const ASTNode *ast) {
     if (!ast) {
         printf("<nullptr>");
@@ -629,7 +712,7 @@ void _ast_print_impl(const ASTNode *ast) {
 
         case ASTTYPE_IDENT: {
             ASTNode_Ident *ident = (void *)ast;
-            printf("Ident(valtype=%s, value=%.*s)", valtype, (int)ident->value.len, ident->value.chars);
+            printf("Ident(valtype=%s, value=%.*s)", valtype, (int)ident->value->len, ident->value->chars);
         } break;
 
         case ASTTYPE_STRLIT: {
@@ -674,6 +757,35 @@ void _ast_print_impl(const ASTNode *ast) {
                 }
             }
         } break;
+
+        case ASTTYPE_CONST: {
+            ASTNode_Const *constant = (void *)ast;
+            printf("Const(valtype=%s, value=", valtype);
+            value_print(constant->value);
+            printf(")");
+        } break;
+
+        case ASTTYPE_INDEX: {
+            ASTNode_Index *index = (void *)ast;
+            printf("Index(valtype=%s, target=", valtype);
+            _ast_print_impl(index->target);
+            printf(", index=");
+            _ast_print_impl(index->index);
+            printf(")");
+        } break;
+
+        case ASTTYPE_SLICE: {
+            ASTNode_Slice *slice = (void *)ast;
+            printf("Slice(valtype=%s, target=", valtype);
+            _ast_print_impl(slice->target);
+            printf(", start=");
+            _ast_print_impl(slice->start);
+            printf(", stop=");
+            _ast_print_impl(slice->stop);
+            printf(", step=");
+            _ast_print_impl(slice->step);
+            printf(")");
+        } break;
     }
 }
 
@@ -687,7 +799,7 @@ void ast_println(const ASTNode *ast) {
 }
 
 
-void print_parseerr(ParseError err, Vnl_String line, const ASTNode *ast, const TokenIterator *titer) {
+void print_parseerr(ParseError err, Vnl_String line, const TokenIterator *titer) {
     switch (err) {
         case PARSEERR_OK: {
             printf(VNL_ANSICOL_GREEN "Error: Success!\n" VNL_ANSICOL_RESET);
@@ -788,6 +900,18 @@ void print_parseerr(ParseError err, Vnl_String line, const ASTNode *ast, const T
             printf("\n");
         } break;
 
+        case PARSEERR_AST_SUBSCRIPT_ASSIGN: {
+            printf(VNL_ANSICOL_RED "Error: Cannot assign to an element or a slice, arrays are read-only\n" VNL_ANSICOL_RESET);
+        } break;
+
+        case PARSEERR_AST_NOT_ASSIGNABLE: {
+            printf(VNL_ANSICOL_RED "Error: Not assignable!\n" VNL_ANSICOL_RESET);
+        } break;
+
+        case PARSEERR_AST_UNSUPPORTED_CALL: {
+            printf(VNL_ANSICOL_RED "Error: Calls are not supported yet\n" VNL_ANSICOL_RESET);
+        } break;
+
     }
 }
 
@@ -815,17 +939,69 @@ typedef enum {
     VM_DUP,
     VM_PUT,
     VM_MAKEARR,
+    VM_INDEX,       // target[index], popping both
+    VM_SLICE,       // target[start:stop:step], popping the target and the given bounds
+
+    // Superinstructions, only produced by code_optimize.
+    VM_ADDK,        // top = top op arg
+    VM_SUBK,
+    VM_MULK,
+    VM_DIVK,
+    VM_MODK,
+    VM_LOADADD,     // top = top op var
+    VM_LOADSUB,
+    VM_LOADMUL,
+    VM_LOADDIV,
+    VM_LOADMOD,
+    VM_STOREKEEP,   // var = top, without popping
+
+    // Quickened forms. exec_code rewrites the arithmetic opcodes above into these once it
+    // has seen their operand types; each one guards on those types and falls back to the
+    // generic opcode when they change.
+    VM_ADD_NUM,
+    VM_SUB_NUM,
+    VM_MUL_NUM,
+    VM_DIV_NUM,
+    VM_MOD_NUM,
+    VM_ADDK_NUM,
+    VM_SUBK_NUM,
+    VM_MULK_NUM,
+    VM_DIVK_NUM,
+    VM_MODK_NUM,
+    VM_LOADADD_NUM,
+    VM_LOADSUB_NUM,
+    VM_LOADMUL_NUM,
+    VM_LOADDIV_NUM,
+    VM_LOADMOD_NUM,
+    VM_ADD_STR,
+    VM_ADDK_STR,
+    VM_LOADADD_STR,
 } VMOpcode;
 
 typedef struct {
     VMOpcode opcode;
     union {
-        Vnl_Object *arg;
-        Vnl_String varname;
+        Vnl_Value arg;
+        struct {
+            const Vnl_Symbol *varname;
+            size_t slot;
+        };
         size_t makearr_len;
+        unsigned slice_parts;
     };
 } Instruction;
 
+// The bounds a slice was given. Only those are compiled, in this order, after the target.
+enum {
+    SLICE_START = 1 << 0,
+    SLICE_STOP  = 1 << 1,
+    SLICE_STEP  = 1 << 2,
+};
+
+size_t slice_parts_count(unsigned parts) {
+    return (size_t)__builtin_popcount(parts);
+}
+
 
 typedef struct {
     Instruction *items;
@@ -839,418 +1015,2508 @@ void code_append(Code *code, Instruction instr) {
     if (code->cap == code->len) {
         size_t newcap = code->cap;
         newcap = newcap ? newcap * 2 : 32;
-        code->items = realloc(code->items, newcap * sizeof(Vnl_Token));
+        code->items = vnl_realloc(code->items, newcap * sizeof(*code->items));
         code->cap = newcap;
     }
     code->items[code->len++] = instr;
 }
 
+bool vm_opcode_is_binop(VMOpcode opcode) {
+    return opcode >= VM_ADD && opcode <= VM_MOD;
+}
 
+bool vm_opcode_is_quickened(VMOpcode opcode) {
+    return opcode >= VM_ADD_NUM;
+}
 
-void object_print(const Vnl_Object *obj) {
-    switch (obj->type) {
-        case VNL_OBJTYPE_NUMBER:
-            printf("%g", ((Vnl_NumberObject*)obj)->value);
-        break;
-
-        case VNL_OBJTYPE_STRING: {
-            Vnl_StringObject *strobj = (void *)obj;
-            vnl_string_print_escaped(vnl_string_from_b(&strobj->value));
-        } break;
-
-        case VNL_OBJTYPE_ARRAY:
-            printf("[");
-            Vnl_ArrayObject *arr = (void *)obj;
-            for (size_t i = 0; i < arr->len; ++i) {
-                object_print(arr->items[i]);
-                if (i < arr->len - 1)
-                    printf(", ");
-            }
-            printf("]");
-        break;
+// Maps a quickened opcode back to the generic one it was made from.
+VMOpcode vm_opcode_generic(VMOpcode opcode) {
+    switch (opcode) {
+        case VM_ADD_STR: return VM_ADD;
+        case VM_ADDK_STR: return VM_ADDK;
+        case VM_LOADADD_STR: return VM_LOADADD;
+        default: break;
     }
+    if (opcode >= VM_LOADADD_NUM) return opcode - VM_LOADADD_NUM + VM_LOADADD;
+    if (opcode >= VM_ADDK_NUM) return opcode - VM_ADDK_NUM + VM_ADDK;
+    if (opcode >= VM_ADD_NUM) return opcode - VM_ADD_NUM + VM_ADD;
+    return opcode;
 }
 
+bool vm_opcode_has_arg(VMOpcode opcode) {
+    opcode = vm_opcode_generic(opcode);
+    return opcode == VM_PUT || (opcode >= VM_ADDK && opcode <= VM_MODK);
+}
 
-void code_print(const Code *code) {
+void code_free(Code *code) {
     for (size_t i = 0; i < code->len; ++i) {
-        Instruction instr = code->items[i];
-        switch (instr.opcode) {
-            case VM_SET: {
-                printf("SET\n");
-            } break;
-
-            case VM_ADD: {
-                printf("ADD\n");
-            } break;
-
-            case VM_SUB: {
-                printf("SUB\n");
-            } break;
-
-            case VM_MUL: {
-                printf("MUL\n");
-            } break;
+        if (vm_opcode_has_arg(code->items[i].opcode)) {
+            vnl_value_release(code->items[i].arg);
+        }
+    }
+    vnl_free(code->items);
+    code->items = nullptr;
+    code->len = 0;
+    code->cap = 0;
+}
 
-            case VM_DIV: {
-                printf("DIV\n");
-            } break;
 
-            case VM_MOD: {
-                printf("MOD\n");
-            } break;
 
-            case VM_LOAD: {
-                printf("LOAD ");
-                vnl_string_println(instr.varname);
-            } break;
+// `Code` is what the compiler and the peephole pass work on. It is assembled into
+// `Bytecode` for execution: one byte per opcode, followed by at most one operand as an
+// unsigned LEB128 varint - an index into `consts` (PUT, the K ops), an index into
+// `names`/`slots` (variable ops), an element count (MAKEARR) or the bounds given (SLICE). The byte stream holds no
+// pointers, so it stays valid wherever it is copied; everything else is in the tables.
+typedef struct {
+    uint8_t *bytes;
+    size_t len;
+    Vnl_Value *consts;
+    size_t nconsts;
+    const Vnl_Symbol **names;
+    size_t *slots;
+    size_t nnames;
+    size_t ninstrs;
+    size_t max_depth;
+    size_t deopts;
+} Bytecode;
 
-            case VM_STORE: {
-                printf("STORE ");
-                vnl_string_println(instr.varname);
-            } break;
+typedef enum {
+    OPERAND_NONE,
+    OPERAND_CONST,
+    OPERAND_VAR,
+    OPERAND_COUNT,
+    OPERAND_PARTS,
+} OperandKind;
+
+OperandKind vm_operand_kind(VMOpcode opcode) {
+    switch (vm_opcode_generic(opcode)) {
+        case VM_PUT:
+        case VM_ADDK:
+        case VM_SUBK:
+        case VM_MULK:
+        case VM_DIVK:
+        case VM_MODK:
+            return OPERAND_CONST;
+        case VM_LOAD:
+        case VM_STORE:
+        case VM_LOADADD:
+        case VM_LOADSUB:
+        case VM_LOADMUL:
+        case VM_LOADDIV:
+        case VM_LOADMOD:
+        case VM_STOREKEEP:
+            return OPERAND_VAR;
+        case VM_MAKEARR:
+            return OPERAND_COUNT;
+        case VM_SLICE:
+            return OPERAND_PARTS;
+        default:
+            return OPERAND_NONE;
+    }
+}
 
-            case VM_ROT: {
-                printf("ROT\n");
-            } break;
+size_t bc_uleb_size(size_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
 
-            case VM_DUP: {
-                printf("DUP\n");
-            } break;
+uint8_t *bc_write_uleb(uint8_t *out, size_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
 
-            case VM_PUT: {
-                printf("PUT ");
-                object_print(instr.arg);
-                printf("\n");
-            } break;
+static inline size_t bc_read(const uint8_t **pc) {
+    const uint8_t *p = *pc;
+    size_t value = *p & 0x7f;
+    for (unsigned shift = 7; *p++ & 0x80; shift += 7) {
+        value |= (size_t)(*p & 0x7f) << shift;
+    }
+    *pc = p;
+    return value;
+}
 
-            case VM_MAKEARR: {
-                printf("MAKEARR %zu\n", instr.makearr_len);
-            } break;
+// Decodes the instruction at `*pc` back into its `Instruction` form and advances `*pc`.
+Instruction bc_decode(const Bytecode *code, const uint8_t **pc) {
+    Instruction instr = { (VMOpcode)*(*pc)++ };
+    switch (vm_operand_kind(instr.opcode)) {
+        case OPERAND_NONE:
+            break;
+        case OPERAND_CONST:
+            instr.arg = code->consts[bc_read(pc)];
+            break;
+        case OPERAND_VAR: {
+            size_t var = bc_read(pc);
+            instr.varname = code->names[var];
+            instr.slot = code->slots[var];
+        } break;
+        case OPERAND_COUNT:
+            instr.makearr_len = bc_read(pc);
+            break;
+        case OPERAND_PARTS:
+            instr.slice_parts = bc_read(pc);
+            break;
+    }
+    return instr;
+}
 
+size_t bc_name_index(const Bytecode *code, size_t slot) {
+    for (size_t i = 0; i < code->nnames; ++i) {
+        if (code->slots[i] == slot) {
+            return i;
         }
     }
+    return code->nnames;
 }
 
-
-
-Vnl_NumberObject *exec_create_number(Vnl_Executor *exec, double value) {
-    Vnl_NumberObject *obj = vnl_object_create(sizeof(*obj), VNL_OBJTYPE_NUMBER);
-    obj->value = value;
-    return obj;
+// Net number of values an instruction pushes (negative if it pops).
+ptrdiff_t vm_stack_effect(const Instruction *instr) {
+    switch (vm_opcode_generic(instr->opcode)) {
+        case VM_PUT:
+        case VM_LOAD:
+        case VM_DUP:
+            return 1;
+        case VM_STORE:
+        case VM_ADD:
+        case VM_SUB:
+        case VM_MUL:
+        case VM_DIV:
+        case VM_MOD:
+        case VM_INDEX:
+            return -1;
+        case VM_MAKEARR:
+            return 1 - (ptrdiff_t)instr->makearr_len;
+        case VM_SLICE:
+            return -(ptrdiff_t)slice_parts_count(instr->slice_parts);
+        default:
+            return 0;
+    }
 }
 
-void exec_stack_push(Vnl_Executor *exec, Vnl_Object *obj) {
-	vnl_object_acquire(obj);
-    if (exec->stack.cap == exec->stack.len) {
-        size_t newcap = exec->stack.cap;
-        newcap = newcap ? newcap * 2 : 32;
-        exec->stack.stack = realloc(exec->stack.stack, newcap * sizeof(Vnl_Token));
-        exec->stack.cap = newcap;
+// The most values the code ever has on the stack at once. No instruction goes above the
+// depth it leaves behind, even while it runs.
+size_t code_max_depth(const Code *code) {
+    ptrdiff_t depth = 0, max_depth = 0;
+    for (size_t i = 0; i < code->len; ++i) {
+        depth += vm_stack_effect(&code->items[i]);
+        if (depth > max_depth) {
+            max_depth = depth;
+        }
     }
-    exec->stack.stack[exec->stack.len++] = obj;
+    return max_depth;
 }
 
+// Consumes `ir`: its constants are moved into the constant table.
+void code_assemble(Code *ir, Bytecode *out) {
+    size_t nbytes = 0, nconsts = 0, nvars = 0;
+    for (size_t i = 0; i < ir->len; ++i) {
+        switch (vm_operand_kind(ir->items[i].opcode)) {
+            case OPERAND_CONST: nconsts++; break;
+            case OPERAND_VAR: nvars++; break;
+            default: break;
+        }
+    }
+
+    *out = (Bytecode){
+        .consts = vnl_malloc(sizeof(*out->consts) * (nconsts ? nconsts : 1)),
+        .names = vnl_malloc(sizeof(*out->names) * (nvars ? nvars : 1)),
+        .slots = vnl_malloc(sizeof(*out->slots) * (nvars ? nvars : 1)),
+        .ninstrs = ir->len,
+        .max_depth = code_max_depth(ir),
+    };
 
-Vnl_Object *exec_stack_pop(Vnl_Executor *exec) {
-    if (exec->stack.len == 0) {
-        return nullptr;
-    } else {
-        Vnl_Object *obj = exec->stack.stack[--exec->stack.len];
-        return obj;
+    // Operands are indices into the tables, so they are filled in before sizing the stream.
+    size_t *operands = vnl_malloc(sizeof(*operands) * (ir->len ? ir->len : 1));
+    for (size_t i = 0; i < ir->len; ++i) {
+        const Instruction *instr = &ir->items[i];
+        switch (vm_operand_kind(instr->opcode)) {
+            case OPERAND_NONE:
+                operands[i] = 0;
+                break;
+            case OPERAND_CONST:
+                operands[i] = out->nconsts;
+                out->consts[out->nconsts++] = instr->arg;
+                break;
+            case OPERAND_VAR:
+                operands[i] = bc_name_index(out, instr->slot);
+                if (operands[i] == out->nnames) {
+                    out->names[out->nnames] = instr->varname;
+                    out->slots[out->nnames++] = instr->slot;
+                }
+                break;
+            case OPERAND_COUNT:
+                operands[i] = instr->makearr_len;
+                break;
+            case OPERAND_PARTS:
+                operands[i] = instr->slice_parts;
+                break;
+        }
+        nbytes += 1;
+        if (vm_operand_kind(instr->opcode) != OPERAND_NONE) {
+            nbytes += bc_uleb_size(operands[i]);
+        }
     }
-}
 
+    out->bytes = vnl_malloc(nbytes ? nbytes : 1);
+    uint8_t *p = out->bytes;
+    for (size_t i = 0; i < ir->len; ++i) {
+        *p++ = (uint8_t)ir->items[i].opcode;
+        if (vm_operand_kind(ir->items[i].opcode) != OPERAND_NONE) {
+            p = bc_write_uleb(p, operands[i]);
+        }
+    }
+    out->len = nbytes;
 
-void exec_set_error(Vnl_Executor *exec, Vnl_Object *err_obj) {
-	vnl_object_release(err_obj);
-    exec->error = err_obj;
-    vnl_object_acquire(err_obj);
+    vnl_free(operands);
+    vnl_free(ir->items);
+    *ir = (Code){};
 }
 
+void bytecode_free(Bytecode *code) {
+    for (size_t i = 0; i < code->nconsts; ++i) {
+        vnl_value_release(code->consts[i]);
+    }
+    vnl_free(code->bytes);
+    vnl_free(code->consts);
+    vnl_free(code->names);
+    vnl_free(code->slots);
+    *code = (Bytecode){};
+}
 
 
-bool obj_is_number(Vnl_Object *obj) {
-    return obj && obj->type == VNL_OBJTYPE_NUMBER;
-}
 
+// Register VM. Binary operations read their operands straight from a register, a
+// constant or a variable, so `a * b` is a single MUL instead of LOAD, LOAD, ROT, MUL.
+// Registers own their values. An operand register is a temporary and is consumed
+// (moved out) by the instruction that reads it.
+typedef enum {
+    RVM_ADD,        // dst = a op b
+    RVM_SUB,
+    RVM_MUL,
+    RVM_DIV,
+    RVM_MOD,
+    RVM_INDEX,      // dst = a[b]
+    RVM_MOVE,       // dst = a
+    RVM_STORE,      // var = reg a (the register keeps its value)
+    RVM_MAKEARR,    // dst = [reg a, ..., reg a + len - 1]
+    RVM_SLICE,      // dst = reg a[reg a + 1 : ...], with the bounds in `slice_parts`
+    RVM_RET,        // push reg a
+} RegOpcode;
 
-bool isintegral(double x) {
-    double i;
-    return modf(x, &i) == 0.0;
-}
+typedef enum {
+    OPND_REG,
+    OPND_CONST,
+    OPND_VAR,
+} RegOperandKind;
 
-bool obj_is_integer(Vnl_Object *obj) {
-    return obj && obj->type == VNL_OBJTYPE_NUMBER && isintegral(((Vnl_NumberObject *)obj)->value);
-}
+typedef uint32_t Reg;
 
-bool obj_is_string(Vnl_Object *obj) {
-    return obj && obj->type == VNL_OBJTYPE_STRING;
-}
+typedef struct {
+    RegOperandKind kind;
+    union {
+        Reg reg;
+        Vnl_Value value;
+        struct {
+            const Vnl_Symbol *varname;
+            size_t slot;
+        };
+    };
+} RegOperand;
 
-Vnl_CString objtype_as_str(Vnl_Object *obj) {
-    static const Vnl_CString OBJTYPE2STR[] = {
-        [VNL_OBJTYPE_NUMBER] = "number",
-        [VNL_OBJTYPE_STRING] = "number",
-        [VNL_OBJTYPE_ARRAY] = "array",
+typedef struct {
+    RegOpcode opcode;
+    Reg dst;
+    RegOperand a;
+    union {
+        RegOperand b;
+        struct {
+            const Vnl_Symbol *varname;
+            size_t slot;
+        };
+        size_t makearr_len;
+        unsigned slice_parts;
     };
-    return OBJTYPE2STR[obj->type];
-}
+} RegInstruction;
 
-int64_t obj_as_integer(Vnl_Object *obj) {
-    return ((Vnl_NumberObject *)obj)->value;
-}
+typedef struct {
+    RegInstruction *items;
+    size_t len;
+    size_t cap;
+    size_t nregs;
+} RegCode;
 
-uint64_t obj_as_uinteger(Vnl_Object *obj) {
-    return ((Vnl_NumberObject *)obj)->value;
-}
 
-void error_invalid_binop_args(OpKind op, Vnl_Object *a, Vnl_Object *b) {
-    if (!a && !b) {
-        printf(VNL_ANSICOL_RED "Error: not enough arguments, stack exceeded!\n" VNL_ANSICOL_RESET);
-        exit(1);
-    } else {
-        OpInfo opinfo = OPINFO_TABLE[op];
-        printf(
-            VNL_ANSICOL_RED "Error: "
-            "Unsupported arguments for operator '%s':"
-            " <%s> and <%s>\n" VNL_ANSICOL_RESET,
-            opinfo.str,
-            objtype_as_str(a),
-            objtype_as_str(b)
-        );
+void regcode_append(RegCode *code, RegInstruction instr) {
+    if (code->cap == code->len) {
+        size_t newcap = code->cap;
+        newcap = newcap ? newcap * 2 : 16;
+        code->items = vnl_realloc(code->items, newcap * sizeof(*code->items));
+        code->cap = newcap;
     }
+    code->items[code->len++] = instr;
 }
 
-
-void obj_array_push(Vnl_ArrayObject *arr, Vnl_Object *obj) {
-    if (arr->cap == arr->len) {
-        size_t newcap = arr->cap;
-        newcap = newcap ? newcap * 2 : 32;
-        arr->items = realloc(arr->items, newcap * sizeof(Vnl_Token));
-        arr->cap = newcap;
-    }
-    arr->items[arr->len++] = obj;
+bool reg_opcode_is_binop(RegOpcode opcode) {
+    return opcode <= RVM_MOD;
 }
 
-
-void obj_arr_reverse(Vnl_ArrayObject *arr) {
-    for (size_t i = 0; i < arr->len / 2; ++i) {
-        Vnl_Object *tmp = arr->items[i];
-        arr->items[i] = arr->items[arr->len - 1 - i];
-        arr->items[arr->len - 1 - i] = tmp;
+void regcode_free(RegCode *code) {
+    for (size_t i = 0; i < code->len; ++i) {
+        const RegInstruction *instr = &code->items[i];
+        if (instr->opcode <= RVM_MOVE && instr->a.kind == OPND_CONST) {
+            vnl_value_release(instr->a.value);
+        }
+        if ((reg_opcode_is_binop(instr->opcode) || instr->opcode == RVM_INDEX) && instr->b.kind == OPND_CONST) {
+            vnl_value_release(instr->b.value);
+        }
     }
+    vnl_free(code->items);
+    *code = (RegCode){};
 }
 
 
+// A compiled statement for either VM.
+// `jit` is compiled lazily once the program has run JIT_HOT_RUNS times with the JIT
+// enabled; `nojit` remembers that it couldn't be.
+struct Vnl_Program {
+    bool regvm;
+    Bytecode code;
+    RegCode regcode;
+    size_t runs;
+    Vnl_JitCode *jit;
+    bool nojit;
+};
 
-ExecError exec_code(Vnl_Executor *exec, const Code *code) {
-    for (size_t pc = 0; pc < code->len; ++pc) {
-        Instruction instr = code->items[pc];
-        switch (instr.opcode) {
-            case VM_SET: {
-                printf(VNL_ANSICOL_RED "TODO: Illegal instruction\n" VNL_ANSICOL_RESET);
-                exit(1);
-            } break;
+void program_free(Vnl_Program *program) {
+    bytecode_free(&program->code);
+    regcode_free(&program->regcode);
+    vnl_jit_free(program->jit);
+}
 
-            case VM_ADD: {
-                Vnl_Object *a = exec_stack_pop(exec);
-                Vnl_Object *b = exec_stack_pop(exec);
-
-                if (obj_is_number(a) && obj_is_number(b)) {
-                    Vnl_NumberObject *anum = (void *)a;
-                    Vnl_NumberObject *bnum = (void *)b;
-                    Vnl_NumberObject *result = exec_create_number(exec, anum->value + bnum->value);
-                    vnl_object_release(a);
-                    vnl_object_release(b);
-                    exec_stack_push(exec, (Vnl_Object *)result);
-                } else if (obj_is_string(a) && obj_is_string(b)) {
-                    Vnl_StringObject *astr = (void *)a;
-                    Vnl_StringObject *bstr = (void *)b;
-                    Vnl_StringObject *result = vnl_object_create(sizeof(*result), VNL_OBJTYPE_STRING);
-                    vnl_strbuf_append_s(&result->value, vnl_string_from_b(&astr->value));
-                    vnl_strbuf_append_s(&result->value, vnl_string_from_b(&bstr->value));
-                    vnl_object_release(a);
-                    vnl_object_release(b);
-                    exec_stack_push(exec, (Vnl_Object *)result);
-                } else {
-                    error_invalid_binop_args(BINOP_ADD, a, b);
-                    return EXEC_ERR;
-                }
-            } break;
 
-            case VM_SUB: {
-                Vnl_Object *a = exec_stack_pop(exec);
-                Vnl_Object *b = exec_stack_pop(exec);
 
-                if (!obj_is_number(a) || !obj_is_number(b)) {
-                    error_invalid_binop_args(BINOP_ADD, a, b);
-                    return EXEC_ERR;
-                }
+#define COMPILE_CACHE_CAPACITY 64
 
-                Vnl_NumberObject *anum = (void *)a;
-                Vnl_NumberObject *bnum = (void *)b;
-                Vnl_NumberObject *result = exec_create_number(exec, anum->value - bnum->value);
-                vnl_object_release(a);
-                vnl_object_release(b);
-                exec_stack_push(exec, (Vnl_Object *)result);
-            } break;
+static const uint64_t COMPILE_CACHE_SEED = 0x76696e796c;
 
-            case VM_MUL: {
-                Vnl_Object *a = exec_stack_pop(exec);
-                Vnl_Object *b = exec_stack_pop(exec);
-
-                if (obj_is_number(a) && obj_is_number(b)) {
-                    Vnl_NumberObject *anum = (void *)a;
-                    Vnl_NumberObject *bnum = (void *)b;
-                    Vnl_NumberObject *result = exec_create_number(exec, anum->value * bnum->value);
-                    vnl_object_release(a);
-                    vnl_object_release(b);
-                    exec_stack_push(exec, (Vnl_Object *)result);
-                } else if (obj_is_integer(a) && obj_is_string(b) && obj_as_integer(a) >= 0) {
-                    size_t times = obj_as_integer(a);
-                    Vnl_StringObject *result = vnl_object_create(sizeof(*result), VNL_OBJTYPE_STRING);
-                    Vnl_StringObject *bstr = (void *)b;
-                    for (size_t i = 0; i < times; ++i) {
-                        vnl_strbuf_append_s(&result->value, vnl_string_from_b(&bstr->value));
-                    }
-                    vnl_object_release(a);
-                    vnl_object_release(b);
-                    exec_stack_push(exec, (Vnl_Object *)result);
-                } else if (obj_is_integer(b) && obj_is_string(a) && obj_as_integer(b) >= 0) {
-                    size_t times = obj_as_integer(b);
-                    Vnl_StringObject *result = vnl_object_create(sizeof(*result), VNL_OBJTYPE_STRING);
-                    Vnl_StringObject *astr = (void *)a;
-                    for (size_t i = 0; i < times; ++i) {
-                        vnl_strbuf_append_s(&result->value, vnl_string_from_b(&astr->value));
-                    }
-                    vnl_object_release(a);
-                    vnl_object_release(b);
-                    exec_stack_push(exec, (Vnl_Object *)result);
-                } else {
-                    error_invalid_binop_args(BINOP_ADD, a, b);
-                    return EXEC_ERR;
-                }
-            } break;
+// Compiled statements keyed by their source text and the compile options. Entries own
+// their program (and through it the constants), so a hit skips tokenizing, parsing and
+// compiling entirely. The cache is small enough that a linear scan beats anything smarter.
+typedef struct {
+    uint64_t hash;
+    unsigned options;
+    Vnl_StringBuffer source;
+    Vnl_Program program;
+    size_t last_used;
+} CompileCacheEntry;
+
+struct CompileCache {
+    CompileCacheEntry entries[COMPILE_CACHE_CAPACITY];
+    size_t len;
+    size_t tick;
+    size_t hits;
+    size_t misses;
+};
 
-            case VM_DIV: {
-                Vnl_Object *a = exec_stack_pop(exec);
-                Vnl_Object *b = exec_stack_pop(exec);
 
-                if (!obj_is_number(a) || !obj_is_number(b)) {
-                    error_invalid_binop_args(BINOP_ADD, a, b);
-                    return EXEC_ERR;
-                }
+Vnl_Program *exec_cache_find(CompileCache *cache, Vnl_String source, uint64_t hash, unsigned options) {
+    for (size_t i = 0; i < cache->len; ++i) {
+        CompileCacheEntry *entry = &cache->entries[i];
+        if (entry->hash == hash && entry->options == options
+                && vnl_string_cmpeq_s(vnl_string_from_b(&entry->source), source)) {
+            entry->last_used = ++cache->tick;
+            cache->hits++;
+            return &entry->program;
+        }
+    }
+    cache->misses++;
+    return nullptr;
+}
 
-                Vnl_NumberObject *anum = (void *)a;
-                Vnl_NumberObject *bnum = (void *)b;
-                Vnl_NumberObject *result = exec_create_number(exec, anum->value / bnum->value);
-                vnl_object_release(a);
-                vnl_object_release(b);
-                exec_stack_push(exec, (Vnl_Object *)result);
-            } break;
+// Takes ownership of `program`, evicting the least recently used entry when full.
+Vnl_Program *exec_cache_insert(CompileCache *cache, Vnl_String source, uint64_t hash, unsigned options, Vnl_Program program) {
+    CompileCacheEntry *entry;
+    if (cache->len < COMPILE_CACHE_CAPACITY) {
+        entry = &cache->entries[cache->len++];
+    } else {
+        entry = &cache->entries[0];
+        for (size_t i = 1; i < cache->len; ++i) {
+            if (cache->entries[i].last_used < entry->last_used) {
+                entry = &cache->entries[i];
+            }
+        }
+        program_free(&entry->program);
+        entry->source.len = 0;
+    }
+    entry->hash = hash;
+    entry->options = options;
+    vnl_strbuf_append_s(&entry->source, source);
+    entry->program = program;
+    entry->last_used = ++cache->tick;
+    return &entry->program;
+}
 
-            case VM_MOD: {
-                Vnl_Object *a = exec_stack_pop(exec);
-                Vnl_Object *b = exec_stack_pop(exec);
+void exec_cache_free(CompileCache *cache) {
+    for (size_t i = 0; i < cache->len; ++i) {
+        program_free(&cache->entries[i].program);
+        vnl_strbuf_free(&cache->entries[i].source);
+    }
+    vnl_free(cache);
+}
 
-                if (!obj_is_number(a) || !obj_is_number(b)) {
-                    error_invalid_binop_args(BINOP_ADD, a, b);
-                    return EXEC_ERR;
-                }
 
-                Vnl_NumberObject *anum = (void *)a;
-                Vnl_NumberObject *bnum = (void *)b;
 
-                Vnl_NumberObject *result = exec_create_number(exec, fmod(anum->value, bnum->value));
-                vnl_object_release(a);
-                vnl_object_release(b);
-                exec_stack_push(exec, (Vnl_Object *)result);
-            } break;
+void value_print(Vnl_Value val) {
+    if (vnl_value_is_number(val)) {
+        printf("%g", vnl_value_as_number(val));
+        return;
+    }
+    if (!vnl_value_is_object(val)) {
+        printf("null");
+        return;
+    }
 
-            case VM_LOAD: {
-                Vnl_String varname = instr.varname;
-                Vnl_Object *obj = vnl_exec_getvar(exec, varname);
-                if (!obj) {
-                    printf(VNL_ANSICOL_RED "Error: Unknown variable: ");
-                    vnl_string_println(varname);
-                    printf(VNL_ANSICOL_RESET);
-                    return EXEC_ERR;
+    const Vnl_Object *obj = vnl_value_as_object(val);
+    switch (obj->type) {
+        case VNL_OBJTYPE_STRING: {
+            Vnl_StringObject *strobj = (void *)obj;
+            vnl_string_print_escaped(vnl_strobj_flatten(strobj));
+        } break;
+
+        case VNL_OBJTYPE_ARRAY:
+            printf("[");
+            Vnl_ArrayObject *arr = (void *)obj;
+            for (size_t i = 0; i < arr->len; ++i) {
+                value_print(arr->items[i]);
+                if (i < arr->len - 1)
+                    printf(", ");
+            }
+            printf("]");
+        break;
+
+        case VNL_OBJTYPE_F64ARRAY:
+            printf("[");
+            Vnl_F64ArrayObject *f64arr = (void *)obj;
+            for (size_t i = 0; i < f64arr->len; ++i) {
+                value_print(vnl_value_from_number(f64arr->items[i]));
+                if (i < f64arr->len - 1)
+                    printf(", ");
+            }
+            printf("]");
+        break;
+
+        case VNL_OBJTYPE_ARRAYVIEW: {
+            printf("[");
+            const Vnl_ArrayViewObject *view = (void *)obj;
+            for (size_t i = 0; i < view->len; ++i) {
+                value_print(vnl_arrview_get(view, i));
+                if (i < view->len - 1)
+                    printf(", ");
+            }
+            printf("]");
+        } break;
+
+        case VNL_OBJTYPE_LAZY: {
+            const Vnl_LazyObject *lazy = (void *)obj;
+            if (vnl_value_is_null(lazy->result)) {
+                printf("<lazy array of %zu>", lazy->len);
+            } else {
+                value_print(lazy->result);
+            }
+        } break;
+    }
+}
+
+
+static const Vnl_CString BINOP_MNEMONICS[] = {
+    [BINOP_ADD] = "ADD",
+    [BINOP_SUB] = "SUB",
+    [BINOP_MUL] = "MUL",
+    [BINOP_DIV] = "DIV",
+    [BINOP_MOD] = "MOD",
+};
+
+// Quickened instructions are listed as their generic form with a `.num`/`.str` suffix.
+void instruction_print(Instruction instr) {
+    Vnl_CString quick = "";
+    if (vm_opcode_is_quickened(instr.opcode)) {
+        quick = instr.opcode >= VM_ADD_STR ? ".str" : ".num";
+    }
+    switch (vm_opcode_generic(instr.opcode)) {
+        case VM_SET: {
+            printf("SET\n");
+        } break;
+
+        case VM_ADD:
+        case VM_SUB:
+        case VM_MUL:
+        case VM_DIV:
+        case VM_MOD: {
+            printf("%s%s\n", BINOP_MNEMONICS[vm_opcode_generic(instr.opcode) - VM_ADD + BINOP_ADD], quick);
+        } break;
+
+        case VM_LOAD: {
+            printf("LOAD ");
+            vnl_string_println(vnl_symbol_str(instr.varname));
+        } break;
+
+        case VM_STORE: {
+            printf("STORE ");
+            vnl_string_println(vnl_symbol_str(instr.varname));
+        } break;
+
+        case VM_ROT: {
+            printf("ROT\n");
+        } break;
+
+        case VM_DUP: {
+            printf("DUP\n");
+        } break;
+
+        case VM_PUT: {
+            printf("PUT ");
+            value_print(instr.arg);
+            printf("\n");
+        } break;
+
+        case VM_MAKEARR: {
+            printf("MAKEARR %zu\n", instr.makearr_len);
+        } break;
+
+        case VM_INDEX: {
+            printf("INDEX\n");
+        } break;
+
+        case VM_SLICE: {
+            printf("SLICE [%s:%s:%s]\n",
+                instr.slice_parts & SLICE_START ? "start" : "",
+                instr.slice_parts & SLICE_STOP ? "stop" : "",
+                instr.slice_parts & SLICE_STEP ? "step" : "");
+        } break;
+
+        case VM_ADDK:
+        case VM_SUBK:
+        case VM_MULK:
+        case VM_DIVK:
+        case VM_MODK: {
+            printf("%sK%s ", BINOP_MNEMONICS[vm_opcode_generic(instr.opcode) - VM_ADDK + BINOP_ADD], quick);
+            value_print(instr.arg);
+            printf("\n");
+        } break;
+
+        case VM_LOADADD:
+        case VM_LOADSUB:
+        case VM_LOADMUL:
+        case VM_LOADDIV:
+        case VM_LOADMOD: {
+            printf("LOAD%s%s ", BINOP_MNEMONICS[vm_opcode_generic(instr.opcode) - VM_LOADADD + BINOP_ADD], quick);
+            vnl_string_println(vnl_symbol_str(instr.varname));
+        } break;
+
+        case VM_STOREKEEP: {
+            printf("STOREKEEP ");
+            vnl_string_println(vnl_symbol_str(instr.varname));
+        } break;
+
+        default:
+            break;
+    }
+}
+
+void code_print(const Code *code) {
+    for (size_t i = 0; i < code->len; ++i) {
+        instruction_print(code->items[i]);
+    }
+}
+
+void bytecode_print(const Bytecode *code) {
+    const uint8_t *pc = code->bytes;
+    while (pc < code->bytes + code->len) {
+        instruction_print(bc_decode(code, &pc));
+    }
+    printf("; %zu instructions in %zu bytes, %zu constants, %zu variables\n", code->ninstrs, code->len, code->nconsts, code->nnames);
+}
+
+void reg_operand_print(const RegOperand *opnd) {
+    switch (opnd->kind) {
+        case OPND_REG: {
+            printf("r%u", (unsigned)opnd->reg);
+        } break;
+
+        case OPND_CONST: {
+            value_print(opnd->value);
+        } break;
+
+        case OPND_VAR: {
+            printf("$");
+            vnl_string_print(vnl_symbol_str(opnd->varname));
+        } break;
+    }
+}
+
+void regcode_print(const RegCode *code) {
+    printf("; %zu registers\n", code->nregs);
+    for (size_t i = 0; i < code->len; ++i) {
+        const RegInstruction *instr = &code->items[i];
+        switch (instr->opcode) {
+            case RVM_ADD:
+            case RVM_SUB:
+            case RVM_MUL:
+            case RVM_DIV:
+            case RVM_MOD: {
+                printf("%s r%u, ", BINOP_MNEMONICS[instr->opcode - RVM_ADD + BINOP_ADD], (unsigned)instr->dst);
+                reg_operand_print(&instr->a);
+                printf(", ");
+                reg_operand_print(&instr->b);
+                printf("\n");
+            } break;
+
+            case RVM_INDEX: {
+                printf("INDEX r%u, ", (unsigned)instr->dst);
+                reg_operand_print(&instr->a);
+                printf(", ");
+                reg_operand_print(&instr->b);
+                printf("\n");
+            } break;
+
+            case RVM_MOVE: {
+                printf("MOVE r%u, ", (unsigned)instr->dst);
+                reg_operand_print(&instr->a);
+                printf("\n");
+            } break;
+
+            case RVM_STORE: {
+                printf("STORE ");
+                vnl_string_print(vnl_symbol_str(instr->varname));
+                printf(", r%u\n", (unsigned)instr->a.reg);
+            } break;
+
+            case RVM_MAKEARR: {
+                printf("MAKEARR r%u, r%u, %zu\n", (unsigned)instr->dst, (unsigned)instr->a.reg, instr->makearr_len);
+            } break;
+
+            case RVM_SLICE: {
+                printf("SLICE r%u, r%u[%s:%s:%s]\n", (unsigned)instr->dst, (unsigned)instr->a.reg,
+                    instr->slice_parts & SLICE_START ? "start" : "",
+                    instr->slice_parts & SLICE_STOP ? "stop" : "",
+                    instr->slice_parts & SLICE_STEP ? "step" : "");
+            } break;
+
+            case RVM_RET: {
+                printf("RET r%u\n", (unsigned)instr->a.reg);
+            } break;
+        }
+    }
+}
+
+
+
+// Values reserved for the VM stack: 8MB of address space, only touched pages cost memory.
+#define VM_STACK_SLOTS ((size_t)1 << 20)
+
+bool exec_stack_init(Vnl_Stack *stack) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t bytes = (VM_STACK_SLOTS * sizeof(Vnl_Value) + page - 1) / page * page;
+    void *mem = mmap(nullptr, bytes + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+    mprotect((char *)mem + bytes, page, PROT_NONE);
+    *stack = (Vnl_Stack){
+        .stack = mem,
+        .len = 0,
+        .cap = bytes / sizeof(Vnl_Value),
+        .mapped = bytes + page,
+    };
+    return true;
+}
+
+void exec_stack_unmap(Vnl_Stack *stack) {
+    munmap(stack->stack, stack->mapped);
+    *stack = (Vnl_Stack){};
+}
+
+// Called before running code that needs up to `depth` more stack slots. Past this check
+// the push, pop and peek below are unchecked.
+bool exec_stack_reserve(Vnl_Executor *exec, size_t depth) {
+    if (depth > exec->stack.cap - exec->stack.len) {
+        printf(VNL_ANSICOL_RED "Error: stack overflow: expression needs %zu stack slots!\n" VNL_ANSICOL_RESET, depth);
+        return false;
+    }
+    return true;
+}
+
+// Pushes a value the caller owns, handing its reference over to the stack.
+static inline void exec_stack_give(Vnl_Executor *exec, Vnl_Value val) {
+    exec->stack.stack[exec->stack.len++] = val;
+}
+
+static inline void exec_stack_push(Vnl_Executor *exec, Vnl_Value val) {
+	vnl_value_acquire(val);
+    exec_stack_give(exec, val);
+}
+
+
+static inline Vnl_Value exec_stack_peek(const Vnl_Executor *exec, size_t depth) {
+    return exec->stack.stack[exec->stack.len - 1 - depth];
+}
+
+static inline Vnl_Value exec_stack_pop(Vnl_Executor *exec) {
+    return exec->stack.stack[--exec->stack.len];
+}
+
+
+void exec_set_error(Vnl_Executor *exec, Vnl_Value err_val) {
+	vnl_value_acquire(err_val);
+	vnl_value_release(exec->error);
+    exec->error = err_val;
+}
+
+
+
+bool val_is_number(Vnl_Value val) {
+    return vnl_value_is_number(val);
+}
+
+
+bool isintegral(double x) {
+    double i;
+    return modf(x, &i) == 0.0;
+}
+
+bool val_is_integer(Vnl_Value val) {
+    return vnl_value_is_number(val) && isintegral(vnl_value_as_number(val));
+}
+
+// Whether a string can be repeated `x` times: a whole number from 0 up to the int64 range,
+// checked before anything casts it. The constant folder asks the same question, so folding
+// never turns a runtime error into a result.
+bool is_repeat_count(double x) {
+    return isintegral(x) && x >= 0 && x < 0x1p63;
+}
+
+bool val_is_string(Vnl_Value val) {
+    return vnl_value_is_object(val) && vnl_value_as_object(val)->type == VNL_OBJTYPE_STRING;
+}
+
+Vnl_CString valtype_as_str(Vnl_Value val) {
+    static const Vnl_CString OBJTYPE2STR[] = {
+        [VNL_OBJTYPE_STRING] = "string",
+        [VNL_OBJTYPE_ARRAY] = "array",
+        [VNL_OBJTYPE_F64ARRAY] = "array",
+        [VNL_OBJTYPE_LAZY] = "array",
+        [VNL_OBJTYPE_ARRAYVIEW] = "array",
+    };
+    if (vnl_value_is_number(val)) {
+        return "number";
+    }
+    if (!vnl_value_is_object(val)) {
+        return "null";
+    }
+    return OBJTYPE2STR[vnl_value_as_object(val)->type];
+}
+
+int64_t val_as_integer(Vnl_Value val) {
+    return vnl_value_as_number(val);
+}
+
+uint64_t val_as_uinteger(Vnl_Value val) {
+    return vnl_value_as_number(val);
+}
+
+void error_invalid_binop_args(OpKind op, Vnl_Value a, Vnl_Value b) {
+    if (vnl_value_is_null(a) && vnl_value_is_null(b)) {
+        printf(VNL_ANSICOL_RED "Error: not enough arguments, stack exceeded!\n" VNL_ANSICOL_RESET);
+        exit(1);
+    } else {
+        OpInfo opinfo = OPINFO_TABLE[op];
+        printf(
+            VNL_ANSICOL_RED "Error: "
+            "Unsupported arguments for operator '%s':"
+            " <%s> and <%s>\n" VNL_ANSICOL_RESET,
+            opinfo.str,
+            valtype_as_str(a),
+            valtype_as_str(b)
+        );
+    }
+    vnl_value_release(a);
+    vnl_value_release(b);
+}
+
+
+void error_unknown_variable(const Vnl_Symbol *varname) {
+    printf(VNL_ANSICOL_RED "Error: Unknown variable: ");
+    vnl_string_println(vnl_symbol_str(varname));
+    printf(VNL_ANSICOL_RESET);
+}
+
+
+// Builds an array out of `len` values, consuming them; the result holds one reference.
+// Arrays of numbers only are stored unboxed, as a Vnl_F64ArrayObject.
+Vnl_Value exec_make_array(Vnl_Executor *exec, const Vnl_Value *items, size_t len) {
+    bool numeric = len > 0;
+    for (size_t i = 0; numeric && i < len; ++i) {
+        numeric = vnl_value_is_number(items[i]);
+    }
+
+    Vnl_Object *obj;
+    if (numeric) {
+        Vnl_F64ArrayObject *arr = vnl_f64arr_new(exec->pool, len);
+        for (size_t i = 0; i < len; ++i) {
+            arr->items[i] = vnl_value_as_number(items[i]);
+        }
+        obj = (Vnl_Object *)arr;
+    } else {
+        Vnl_ArrayObject *arr = vnl_object_create(exec->pool, sizeof(*arr), VNL_OBJTYPE_ARRAY);
+        arr->items = vnl_malloc(sizeof(*arr->items) * (len ? len : 1));
+        memcpy(arr->items, items, sizeof(*arr->items) * len);
+        arr->len = len;
+        arr->cap = len;
+        obj = (Vnl_Object *)arr;
+    }
+
+    Vnl_Value val = vnl_value_from_object(obj);
+    vnl_value_acquire(val);
+    return val;
+}
+
+
+
+// `s = s + x` stores the result of the addition straight back into `s`. When that
+// variable is the only other owner of the operand, drop its reference ahead of the store
+// so the operand becomes unique and can be reused in place.
+void exec_steal_store_target(Vnl_Executor *exec, size_t target, Vnl_Value operand) {
+    if (target == VNL_VARTABLE_NOSLOT) {
+        return;
+    }
+    Vnl_Value current = vnl_vartable_get(exec->vars, target);
+    if (!vnl_value_is_same(current, operand) || vnl_value_as_object(operand)->refcount != 2) {
+        return;
+    }
+    vnl_vartable_set(exec->vars, target, VNL_NULL);
+}
+
+// In stack code the pattern is ADD, DUP, STORE s or, once optimized, ADD, STOREKEEP s.
+// `next` points at the instruction after the addition.
+size_t bc_store_target(const Bytecode *code, const uint8_t *next) {
+    const uint8_t *end = code->bytes + code->len;
+    if (next == end) {
+        return VNL_VARTABLE_NOSLOT;
+    }
+    Instruction instr = bc_decode(code, &next);
+    if (instr.opcode == VM_STOREKEEP) {
+        return instr.slot;
+    }
+    if (instr.opcode == VM_DUP && next < end) {
+        instr = bc_decode(code, &next);
+        if (instr.opcode == VM_STORE) {
+            return instr.slot;
+        }
+    }
+    return VNL_VARTABLE_NOSLOT;
+}
+
+
+
+Vnl_StringObject *exec_string_repeat(Vnl_Executor *exec, Vnl_StringObject *str, size_t times) {
+    if (times && str->len > SIZE_MAX / times) {
+        printf(VNL_ANSICOL_RED "Error: string repetition is too long!\n" VNL_ANSICOL_RESET);
+        return nullptr;
+    }
+    // A repeat rope is cheap, but it flattens to its full length on first use.
+    if (vnl_heap_would_exceed(&exec->heap, str->len * times)) {
+        printf(VNL_ANSICOL_RED "Error: memory limit exceeded!\n" VNL_ANSICOL_RESET);
+        return nullptr;
+    }
+    return vnl_strobj_repeat(exec->pool, str, times);
+}
+
+
+
+// Always inlined with a constant `op`, which leaves just the arithmetic.
+static inline double num_binop(OpKind op, double x, double y) {
+    switch (op) {
+        case BINOP_ADD: return x + y;
+        case BINOP_SUB: return x - y;
+        case BINOP_MUL: return x * y;
+        case BINOP_DIV: return x / y;
+        case BINOP_MOD: return fmod(x, y);
+        default: return NAN;
+    }
+}
+
+// Concatenates two strings, consuming both.
+ExecError exec_string_concat(Vnl_Executor *exec, Vnl_Value a, Vnl_Value b, size_t target, Vnl_Value *result) {
+    Vnl_StringObject *astr = (void *)vnl_value_as_object(a);
+    Vnl_StringObject *bstr = (void *)vnl_value_as_object(b);
+    if (vnl_heap_would_exceed(&exec->heap, astr->len + bstr->len)) {
+        printf(VNL_ANSICOL_RED "Error: memory limit exceeded!\n" VNL_ANSICOL_RESET);
+        vnl_value_release(a);
+        vnl_value_release(b);
+        return EXEC_ERR;
+    }
+    exec_steal_store_target(exec, target, a);
+    if (vnl_object_is_unique(&astr->__base__) && astr->kind == VNL_STRKIND_FLAT) {
+        vnl_strobj_append(astr, vnl_strobj_flatten(bstr));
+        vnl_value_release(b);
+        *result = a;
+    } else {
+        *result = vnl_value_from_object((Vnl_Object *)vnl_strobj_concat(exec->pool, astr, bstr));
+        vnl_value_acquire(*result);
+        vnl_value_release(a);
+        vnl_value_release(b);
+    }
+    return EXEC_OK;
+}
+
+ExecError exec_binop(Vnl_Executor *exec, OpKind op, Vnl_Value a, Vnl_Value b, size_t target, Vnl_Value *result);
+
+bool val_is_array(Vnl_Value val) {
+    if (!vnl_value_is_object(val)) {
+        return false;
+    }
+    Vnl_ObjectType type = vnl_value_as_object(val)->type;
+    return type == VNL_OBJTYPE_ARRAY || type == VNL_OBJTYPE_F64ARRAY || type == VNL_OBJTYPE_ARRAYVIEW;
+}
+
+bool val_is_f64array(Vnl_Value val) {
+    return vnl_value_is_object(val) && vnl_value_as_object(val)->type == VNL_OBJTYPE_F64ARRAY;
+}
+
+bool val_is_lazy(Vnl_Value val) {
+    return vnl_value_is_object(val) && vnl_value_as_object(val)->type == VNL_OBJTYPE_LAZY;
+}
+
+bool val_is_arrayview(Vnl_Value val) {
+    return vnl_value_is_object(val) && vnl_value_as_object(val)->type == VNL_OBJTYPE_ARRAYVIEW;
+}
+
+// A view of a number array, which arithmetic can read without boxing.
+bool val_is_f64view(Vnl_Value val) {
+    return val_is_arrayview(val)
+        && ((const Vnl_ArrayViewObject *)vnl_value_as_object(val))->base->type == VNL_OBJTYPE_F64ARRAY;
+}
+
+// Generic and number arrays share their layout, so their length is read the same way.
+size_t val_array_len(Vnl_Value val) {
+    if (val_is_arrayview(val)) {
+        return ((const Vnl_ArrayViewObject *)vnl_value_as_object(val))->len;
+    }
+    return ((const Vnl_ArrayObject *)vnl_value_as_object(val))->len;
+}
+
+// An owned reference to item `i` of an array, or to the value itself if it isn't one.
+Vnl_Value val_array_item(Vnl_Value val, size_t i) {
+    if (val_is_f64array(val)) {
+        return vnl_value_from_number(((const Vnl_F64ArrayObject *)vnl_value_as_object(val))->items[i]);
+    }
+    if (!val_is_array(val)) {
+        vnl_value_acquire(val);
+        return val;
+    }
+    Vnl_Value item = val_is_arrayview(val)
+        ? vnl_arrview_get((const Vnl_ArrayViewObject *)vnl_value_as_object(val), i)
+        : ((const Vnl_ArrayObject *)vnl_value_as_object(val))->items[i];
+    vnl_value_acquire(item);
+    return item;
+}
+
+Vnl_KernelOp binop_kernel_op(OpKind op) {
+    switch (op) {
+        case BINOP_ADD: return VNL_KERNEL_ADD;
+        case BINOP_SUB: return VNL_KERNEL_SUB;
+        case BINOP_MUL: return VNL_KERNEL_MUL;
+        case BINOP_DIV: return VNL_KERNEL_DIV;
+        default: return VNL_KERNEL_MOD;
+    }
+}
+
+// Array operations on at least `__parallel_threshold__` items are split across the thread
+// pool, in chunks of PARALLEL_GRAIN items: 128 KiB per operand, so a chunk stays in L2.
+static const size_t PARALLEL_THRESHOLD = 1 << 20;
+static const size_t PARALLEL_GRAIN = 1 << 14;
+
+// Lazy trees are evaluated FUSE_CHUNK items at a time, so every intermediate result fits
+// in a small buffer that stays in L1. Bigger trees are cut by evaluating a subtree first.
+#define FUSE_CHUNK 512
+#define FUSE_MAX_NODES 16
+
+bool val_is_numeric(Vnl_Value val) {
+    return val_is_number(val) || val_is_f64array(val) || val_is_f64view(val) || val_is_lazy(val);
+}
+
+// Whether `val` is an array or a lazy operation, and its length if so.
+bool val_array_shape(Vnl_Value val, size_t *len) {
+    *len = 1;
+    if (val_is_lazy(val)) {
+        *len = ((const Vnl_LazyObject *)vnl_value_as_object(val))->len;
+        return true;
+    }
+    if (val_is_array(val)) {
+        *len = val_array_len(val);
+        return true;
+    }
+    return false;
+}
+
+size_t val_lazy_nodes(Vnl_Value val) {
+    return val_is_lazy(val) ? ((const Vnl_LazyObject *)vnl_value_as_object(val))->nodes : 0;
+}
+
+// The length of `a op b`. A number, or an array of length 1, is broadcast against the
+// other side; otherwise the lengths have to match.
+bool binop_broadcast(OpKind op, Vnl_Value a, Vnl_Value b, size_t *len, bool *abroadcast, bool *bbroadcast) {
+    size_t alen, blen;
+    bool aarray = val_array_shape(a, &alen);
+    bool barray = val_array_shape(b, &blen);
+    *abroadcast = !aarray || (alen == 1 && blen != 1);
+    *bbroadcast = !barray || (blen == 1 && alen != 1);
+    *len = *abroadcast ? blen : alen;
+    if (!*abroadcast && !*bbroadcast && alen != blen) {
+        printf(
+            VNL_ANSICOL_RED "Error: "
+            "Array lengths don't match for operator '%s': %zu and %zu\n" VNL_ANSICOL_RESET,
+            OPINFO_TABLE[op].str, alen, blen
+        );
+        return false;
+    }
+    return true;
+}
+
+void fuse_eval(Vnl_KernelIsa isa, const Vnl_LazyObject *node, size_t begin, size_t n, double *out, double *scratch);
+
+// Points `*items` at items [begin, begin + n) of an operand of a `len` item operation,
+// evaluating it into the next FUSE_CHUNK of `*scratch` if it is lazy, or gathering it
+// there if it is a strided view. A broadcast operand is stored in `*num` instead, and
+// false is returned.
+bool fuse_operand(Vnl_KernelIsa isa, Vnl_Value operand, size_t len, size_t begin, size_t n, const double **items, double *num, double **scratch) {
+    if (val_is_lazy(operand)) {
+        double *buf = *scratch;
+        *scratch += FUSE_CHUNK;
+        fuse_eval(isa, (const Vnl_LazyObject *)vnl_value_as_object(operand), begin, n, buf, *scratch);
+        *items = buf;
+        return true;
+    }
+    if (val_is_arrayview(operand)) {
+        const Vnl_ArrayViewObject *view = (void *)vnl_value_as_object(operand);
+        const double *base = ((const Vnl_F64ArrayObject *)view->base)->items + view->start;
+        if (view->len != len) {
+            *num = base[0];
+            return false;
+        }
+        if (view->step == 1) {
+            *items = base + begin;
+            return true;
+        }
+        double *buf = *scratch;
+        *scratch += FUSE_CHUNK;
+        for (size_t i = 0; i < n; ++i) {
+            buf[i] = base[(ptrdiff_t)(begin + i) * view->step];
+        }
+        *items = buf;
+        return true;
+    }
+    if (val_is_f64array(operand)) {
+        const Vnl_F64ArrayObject *arr = (void *)vnl_value_as_object(operand);
+        if (arr->len == len) {
+            *items = arr->items + begin;
+            return true;
+        }
+        *num = arr->items[0];
+        return false;
+    }
+    *num = vnl_value_as_number(operand);
+    return false;
+}
+
+// Evaluates items [begin, begin + n) of `node` into `out`, with one kernel call per node.
+// Only one side of a node can be broadcast, as its length comes from the other one.
+void fuse_eval(Vnl_KernelIsa isa, const Vnl_LazyObject *node, size_t begin, size_t n, double *out, double *scratch) {
+    const double *a, *b;
+    double anum, bnum;
+    bool avec = fuse_operand(isa, node->lhs, node->len, begin, n, &a, &anum, &scratch);
+    bool bvec = fuse_operand(isa, node->rhs, node->len, begin, n, &b, &bnum, &scratch);
+    if (avec && bvec) {
+        vnl_kernel_vv(isa, node->op, out, a, b, n);
+    } else if (bvec) {
+        vnl_kernel_sv(isa, node->op, out, anum, b, n);
+    } else {
+        vnl_kernel_vs(isa, node->op, out, a, bnum, n);
+    }
+}
+
+// `isa` is the executor's `__simd__` cap, carried along because pool threads run the job.
+typedef struct {
+    const Vnl_LazyObject *root;
+    double *dst;
+    Vnl_KernelIsa isa;
+} FuseJob;
+
+// Every operand of every node on the way down the tree may hold a chunk of scratch.
+void fuse_run(void *ctx, size_t begin, size_t end) {
+    const FuseJob *job = ctx;
+    double scratch[2 * FUSE_MAX_NODES * FUSE_CHUNK];
+    for (size_t i = begin; i < end; i += FUSE_CHUNK) {
+        size_t n = end - i < FUSE_CHUNK ? end - i : FUSE_CHUNK;
+        fuse_eval(job->isa, job->root, i, n, job->dst + i, scratch);
+    }
+}
+
+// A full-length number array in the tree that nothing else refers to can hold the
+// result: every chunk of it is read before that chunk is written. Only unshared lazy
+// nodes are looked into, since a shared one may still be evaluated from elsewhere.
+Vnl_Value lazy_reusable_buffer(const Vnl_LazyObject *node) {
+    const Vnl_Value operands[] = { node->lhs, node->rhs };
+    for (size_t i = 0; i < 2; ++i) {
+        Vnl_Value operand = operands[i];
+        if (!vnl_value_is_object(operand) || !vnl_object_is_unique(vnl_value_as_object(operand))) {
+            continue;
+        }
+        if (val_is_f64array(operand) && val_array_len(operand) == node->len) {
+            return operand;
+        }
+        if (val_is_lazy(operand)) {
+            Vnl_Value found = lazy_reusable_buffer((const Vnl_LazyObject *)vnl_value_as_object(operand));
+            if (!vnl_value_is_null(found)) {
+                return found;
+            }
+        }
+    }
+    return VNL_NULL;
+}
+
+// Computes the whole tree in one pass over memory and keeps the result in the node.
+ExecError lazy_evaluate(Vnl_Executor *exec, Vnl_LazyObject *lazy) {
+    Vnl_Value dst = lazy_reusable_buffer(lazy);
+    if (vnl_value_is_null(dst)) {
+        if (vnl_heap_would_exceed(&exec->heap, sizeof(double) * lazy->len)) {
+            printf(VNL_ANSICOL_RED "Error: memory limit exceeded!\n" VNL_ANSICOL_RESET);
+            return EXEC_ERR;
+        }
+        dst = vnl_value_from_object((Vnl_Object *)vnl_f64arr_new(exec->pool, lazy->len));
+    }
+    vnl_value_acquire(dst);
+
+    FuseJob job = { lazy, ((Vnl_F64ArrayObject *)vnl_value_as_object(dst))->items, exec->simd };
+    if (lazy->len >= exec->parallel_threshold) {
+        vnl_parallel_for(exec->threads, lazy->len, PARALLEL_GRAIN, fuse_run, &job);
+    } else {
+        fuse_run(&job, 0, lazy->len);
+    }
+
+    vnl_value_release(lazy->lhs);
+    vnl_value_release(lazy->rhs);
+    lazy->lhs = VNL_NULL;
+    lazy->rhs = VNL_NULL;
+    lazy->result = dst;
+    return EXEC_OK;
+}
+
+// Replaces a lazy operation with its result, evaluating it unless that was done before.
+// Anything else is left alone. Lazy values never outlive the expression that made them:
+// storing, printing or putting a value into an array forces it first.
+ExecError exec_force(Vnl_Executor *exec, Vnl_Value *val) {
+    if (!val_is_lazy(*val)) {
+        return EXEC_OK;
+    }
+    Vnl_LazyObject *lazy = (void *)vnl_value_as_object(*val);
+    if (vnl_value_is_null(lazy->result) && lazy_evaluate(exec, lazy)) {
+        return EXEC_ERR;
+    }
+    Vnl_Value result = lazy->result;
+    vnl_value_acquire(result);
+    vnl_value_release(*val);
+    *val = result;
+    return EXEC_OK;
+}
+
+ExecError exec_force_all(Vnl_Executor *exec, Vnl_Value *vals, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (exec_force(exec, &vals[i])) {
+            return EXEC_ERR;
+        }
+    }
+    return EXEC_OK;
+}
+
+bool lazy_should_force(Vnl_Value val, bool broadcast, size_t nodes) {
+    if (!val_is_lazy(val)) {
+        return false;
+    }
+    const Vnl_LazyObject *lazy = (void *)vnl_value_as_object(val);
+    return broadcast || nodes > FUSE_MAX_NODES || !vnl_value_is_null(lazy->result);
+}
+
+// Arithmetic on numbers, number arrays and lazy operations, at least one of them not a
+// number: nothing is computed yet, the operation becomes a lazy node over its operands.
+// Operands already evaluated are replaced by their result; a broadcast lazy operand (one
+// item) and trees that would grow past FUSE_MAX_NODES are evaluated now.
+ExecError exec_defer_binop(Vnl_Executor *exec, OpKind op, Vnl_Value a, Vnl_Value b, size_t target, Vnl_Value *result) {
+    size_t len;
+    bool abroadcast, bbroadcast;
+    if (!binop_broadcast(op, a, b, &len, &abroadcast, &bbroadcast)) {
+        vnl_value_release(a);
+        vnl_value_release(b);
+        return EXEC_ERR;
+    }
+    if ((lazy_should_force(a, abroadcast, 1 + val_lazy_nodes(a) + val_lazy_nodes(b)) && exec_force(exec, &a))
+        || (lazy_should_force(b, bbroadcast, 1 + val_lazy_nodes(a) + val_lazy_nodes(b)) && exec_force(exec, &b))) {
+        vnl_value_release(a);
+        vnl_value_release(b);
+        return EXEC_ERR;
+    }
+
+    // Lets `a = a + 1` reuse the array of `a` for its result.
+    if (val_is_f64array(a) && !abroadcast) {
+        exec_steal_store_target(exec, target, a);
+    }
+
+    Vnl_LazyObject *lazy = vnl_object_create(exec->pool, sizeof(*lazy), VNL_OBJTYPE_LAZY);
+    lazy->op = binop_kernel_op(op);
+    lazy->len = len;
+    lazy->nodes = 1 + val_lazy_nodes(a) + val_lazy_nodes(b);
+    lazy->lhs = a;
+    lazy->rhs = b;
+    lazy->result = VNL_NULL;
+    *result = vnl_value_from_object((Vnl_Object *)lazy);
+    vnl_value_acquire(*result);
+    return EXEC_OK;
+}
+
+// Element-wise arithmetic with at least one array operand, broadcast as in
+// binop_broadcast. Number arrays are deferred into lazy operations; anything else
+// applies exec_binop to each pair of items. Consumes `a` and `b` like exec_binop.
+ExecError exec_array_binop(Vnl_Executor *exec, OpKind op, Vnl_Value a, Vnl_Value b, size_t target, Vnl_Value *result) {
+    if (op < BINOP_ADD || op > BINOP_MOD) {
+        error_invalid_binop_args(op, a, b);
+        return EXEC_ERR;
+    }
+    if (val_is_numeric(a) && val_is_numeric(b)) {
+        return exec_defer_binop(exec, op, a, b, target, result);
+    }
+
+    size_t len;
+    bool abroadcast, bbroadcast;
+    if (exec_force(exec, &a) || exec_force(exec, &b) || !binop_broadcast(op, a, b, &len, &abroadcast, &bbroadcast)) {
+        vnl_value_release(a);
+        vnl_value_release(b);
+        return EXEC_ERR;
+    }
+    Vnl_Value *items = vnl_malloc(sizeof(*items) * (len ? len : 1));
+    for (size_t i = 0; i < len; ++i) {
+        Vnl_Value x = val_array_item(a, abroadcast ? 0 : i);
+        Vnl_Value y = val_array_item(b, bbroadcast ? 0 : i);
+        // Items of an array are never lazy, so nested number arrays are evaluated here.
+        bool ok = !exec_binop(exec, op, x, y, VNL_VARTABLE_NOSLOT, &items[i]);
+        if (!ok || exec_force(exec, &items[i])) {
+            for (size_t j = 0; j < i + ok; ++j) {
+                vnl_value_release(items[j]);
+            }
+            vnl_free(items);
+            vnl_value_release(a);
+            vnl_value_release(b);
+            return EXEC_ERR;
+        }
+    }
+    *result = exec_make_array(exec, items, len);
+    vnl_free(items);
+    vnl_value_release(a);
+    vnl_value_release(b);
+    return EXEC_OK;
+}
+
+// Arithmetic shared by both VMs. Consumes `a` (the left operand) and `b` and stores an
+// owned reference to the result. `target` is the variable the result is about to be
+// stored into, or VNL_VARTABLE_NOSLOT.
+ExecError exec_binop(Vnl_Executor *exec, OpKind op, Vnl_Value a, Vnl_Value b, size_t target, Vnl_Value *result) {
+    if (val_is_array(a) || val_is_array(b) || val_is_lazy(a) || val_is_lazy(b)) {
+        return exec_array_binop(exec, op, a, b, target, result);
+    }
+    if (val_is_number(a) && val_is_number(b)) {
+        if (op >= BINOP_ADD && op <= BINOP_MOD) {
+            *result = vnl_value_from_number(num_binop(op, vnl_value_as_number(a), vnl_value_as_number(b)));
+            return EXEC_OK;
+        }
+    } else if (op == BINOP_ADD && val_is_string(a) && val_is_string(b)) {
+        return exec_string_concat(exec, a, b, target, result);
+    } else if (op == BINOP_MUL && (val_is_string(a) || val_is_string(b))) {
+        Vnl_Value str = val_is_string(a) ? a : b;
+        Vnl_Value times = val_is_string(a) ? b : a;
+        if (val_is_number(times) && is_repeat_count(vnl_value_as_number(times))) {
+            Vnl_StringObject *repeated = exec_string_repeat(exec, (void *)vnl_value_as_object(str), val_as_integer(times));
+            vnl_value_release(str);
+            if (!repeated) {
+                return EXEC_ERR;
+            }
+            *result = vnl_value_from_object((Vnl_Object *)repeated);
+            vnl_value_acquire(*result);
+            return EXEC_OK;
+        }
+    }
+
+    error_invalid_binop_args(op, a, b);
+    return EXEC_ERR;
+}
+
+
+// Applies `op` to the top of the stack and `b`, which is consumed.
+ExecError exec_binop_top(Vnl_Executor *exec, OpKind op, Vnl_Value b, size_t target) {
+    Vnl_Value a = exec_stack_pop(exec);
+    Vnl_Value result;
+    if (exec_binop(exec, op, a, b, target, &result)) {
+        return EXEC_ERR;
+    }
+    exec_stack_give(exec, result);
+    return EXEC_OK;
+}
+
+
+
+// Indexing and slicing. Negative indices and bounds count from the end of the array, as
+// in Python. A slice is a view of the array it was taken from, so it costs no copy.
+
+bool val_as_index(Vnl_Value val, double *index) {
+    if (val_is_integer(val)) {
+        *index = vnl_value_as_number(val);
+        return true;
+    }
+    if (val_is_number(val)) {
+        printf(VNL_ANSICOL_RED "Error: Array indices have to be integers, got %g\n" VNL_ANSICOL_RESET, vnl_value_as_number(val));
+    } else {
+        printf(VNL_ANSICOL_RED "Error: Array indices have to be integers, got <%s>\n" VNL_ANSICOL_RESET, valtype_as_str(val));
+    }
+    return false;
+}
+
+// Lazy operations are evaluated first; indexing one is as good as storing it.
+bool exec_index_target(Vnl_Executor *exec, Vnl_Value *target) {
+    if (exec_force(exec, target)) {
+        return false;
+    }
+    if (!val_is_array(*target)) {
+        printf(VNL_ANSICOL_RED "Error: Only arrays can be indexed, got <%s>\n" VNL_ANSICOL_RESET, valtype_as_str(*target));
+        return false;
+    }
+    return true;
+}
+
+// `target[index]`. Consumes both.
+ExecError exec_index(Vnl_Executor *exec, Vnl_Value target, Vnl_Value index, Vnl_Value *result) {
+    double i;
+    bool ok = exec_index_target(exec, &target) && val_as_index(index, &i);
+    if (ok) {
+        size_t len = val_array_len(target);
+        double at = i < 0 ? i + len : i;
+        if (at < 0 || at >= len) {
+            printf(VNL_ANSICOL_RED "Error: Index %g is out of range for an array of length %zu\n" VNL_ANSICOL_RESET, i, len);
+            ok = false;
+        } else {
+            *result = val_array_item(target, (size_t)at);
+        }
+    }
+    vnl_value_release(target);
+    vnl_value_release(index);
+    return ok ? EXEC_OK : EXEC_ERR;
+}
+
+// Which items `[start:stop:step]` picks out of `len`, by Python's rules: bounds past
+// either end are clamped, and a bound left out (NAN) runs to that end of the array in
+// the direction of `step`. Returns the number of items.
+size_t slice_resolve(size_t len, const double bounds[3], ptrdiff_t *start, ptrdiff_t *step) {
+    double dstep = bounds[2];
+    double lo = dstep > 0 ? 0 : -1;
+    double hi = dstep > 0 ? (double)len : (double)len - 1;
+    double resolved[2];
+    for (size_t i = 0; i < 2; ++i) {
+        double bound = bounds[i];
+        if (isnan(bound)) {
+            bound = (i == 0) == (dstep > 0) ? lo : hi;
+        } else if (bound < 0) {
+            bound += len;
+        }
+        resolved[i] = bound < lo ? lo : bound > hi ? hi : bound;
+    }
+    // A step longer than the array picks one item at most, so capping it changes nothing.
+    double cap = len ? (double)len : 1;
+    dstep = dstep > cap ? cap : dstep < -cap ? -cap : dstep;
+
+    *start = (ptrdiff_t)resolved[0];
+    *step = (ptrdiff_t)dstep;
+    ptrdiff_t stop = (ptrdiff_t)resolved[1];
+    if (*step > 0) {
+        return stop > *start ? (size_t)((stop - *start - 1) / *step + 1) : 0;
+    }
+    return *start > stop ? (size_t)((*start - stop - 1) / -*step + 1) : 0;
+}
+
+// `values[0][start:stop:step]`, with the bounds in `parts` following it in that order.
+// Consumes the values; `result` may point at one of them.
+ExecError exec_slice(Vnl_Executor *exec, Vnl_Value *values, unsigned parts, Vnl_Value *result) {
+    double bounds[3] = { NAN, NAN, 1 };
+    bool ok = exec_index_target(exec, &values[0]);
+    size_t nvalues = 1;
+    for (size_t i = 0; i < 3; ++i) {
+        if (parts & (1u << i)) {
+            ok = ok && val_as_index(values[nvalues], &bounds[i]);
+            nvalues++;
+        }
+    }
+    if (ok && bounds[2] == 0) {
+        printf(VNL_ANSICOL_RED "Error: Slice step can't be 0\n" VNL_ANSICOL_RESET);
+        ok = false;
+    }
+
+    Vnl_Value view = VNL_NULL;
+    if (ok) {
+        ptrdiff_t start, step;
+        size_t len = slice_resolve(val_array_len(values[0]), bounds, &start, &step);
+        view = vnl_value_from_object((Vnl_Object *)vnl_arrview_new(exec->pool, vnl_value_as_object(values[0]), start, step, len));
+        vnl_value_acquire(view);
+    }
+    for (size_t i = 0; i < nvalues; ++i) {
+        vnl_value_release(values[i]);
+    }
+    if (ok) {
+        *result = view;
+    }
+    return ok ? EXEC_OK : EXEC_ERR;
+}
+
+
+// Called once the heap went over its limit: garbage still queued for incremental
+// destruction doesn't count against the script, so drain it before giving up.
+bool exec_heap_over_limit(Vnl_Executor *exec) {
+    vnl_object_collect(exec->pool, SIZE_MAX);
+    exec->heap.exceeded = exec->heap.live_bytes > exec->heap.limit;
+    if (exec->heap.exceeded) {
+        printf(
+            VNL_ANSICOL_RED "Error: memory limit exceeded: %zu of %zu bytes in use!\n" VNL_ANSICOL_RESET,
+            exec->heap.live_bytes,
+            exec->heap.limit
+        );
+    }
+    return exec->heap.exceeded;
+}
+
+
+// Code whose guards keep failing is left generic for good. Defining VNL_NO_QUICKEN leaves
+// all code generic, to measure what quickening buys.
+#ifdef VNL_NO_QUICKEN
+static const size_t QUICKEN_MAX_DEOPTS = 0;
+#else
+static const size_t QUICKEN_MAX_DEOPTS = 16;
+#endif
+
+// Called by the generic arithmetic handlers with the opcode byte at `ip` and the operands
+// they are about to consume (`a` is the left one). Only combinations with a fast path are
+// quickened. Quickened opcodes take the same operand, so rewriting the byte is enough.
+void bc_quicken(Bytecode *code, const uint8_t *at, Vnl_Value a, Vnl_Value b) {
+    if (code->deopts >= QUICKEN_MAX_DEOPTS) {
+        return;
+    }
+    uint8_t *ip = code->bytes + (at - code->bytes);
+    VMOpcode opcode = *ip;
+    if (val_is_number(a) && val_is_number(b)) {
+        if (vm_opcode_is_binop(opcode)) {
+            *ip = opcode - VM_ADD + VM_ADD_NUM;
+        } else if (opcode >= VM_ADDK && opcode <= VM_MODK) {
+            *ip = opcode - VM_ADDK + VM_ADDK_NUM;
+        } else {
+            *ip = opcode - VM_LOADADD + VM_LOADADD_NUM;
+        }
+    } else if (val_is_string(a) && val_is_string(b)) {
+        switch (opcode) {
+            case VM_ADD: *ip = VM_ADD_STR; break;
+            case VM_ADDK: *ip = VM_ADDK_STR; break;
+            case VM_LOADADD: *ip = VM_LOADADD_STR; break;
+            default: break;
+        }
+    }
+}
+
+void bc_deopt(Bytecode *code, const uint8_t *at) {
+    uint8_t *ip = code->bytes + (at - code->bytes);
+    *ip = vm_opcode_generic(*ip);
+    code->deopts++;
+}
+
+// Handlers end in VM_NEXT(). With labels-as-values each handler jumps straight to the
+// next one through DISPATCH; otherwise it goes back around the switch. Either way the
+// per-instruction housekeeping only runs in the loop head, and only when it has work to do.
+// Each VM defines VM_FETCH() (the current opcode) and VM_ADVANCE() (step to the next one).
+#if defined(__GNUC__) && !defined(VNL_SWITCH_DISPATCH)
+#define VM_CASE(op) case op: op_##op
+#define VM_DISPATCH() goto *DISPATCH[VM_FETCH()]
+#define VM_NEXT() { VM_ADVANCE(); if (ip == end || exec->free_budget || exec->heap.exceeded) continue; VM_DISPATCH(); }
+#else
+#define VM_CASE(op) case op
+#define VM_DISPATCH()
+#define VM_NEXT() { VM_ADVANCE(); continue; }
+#endif
+
+// In bytecode, `pc` walks over the operands of the instruction at `ip`.
+#define VM_FETCH() (pc = ip + 1, *ip)
+#define VM_ADVANCE() (ip = pc)
+// Runs the current instruction again, e.g. after it was deoptimised.
+#define VM_AGAIN() { VM_DISPATCH(); continue; }
+
+// Number fast paths. Both operands are guarded, so a failing guard (a wrong type, an unset
+// variable) lands in the generic handler, which reports it.
+#define VM_QUICK_NUM(opcode, op) \
+    VM_CASE(opcode): { \
+        Vnl_Value a = exec_stack_peek(exec, 0), b = exec_stack_peek(exec, 1); \
+        if (!val_is_number(a) || !val_is_number(b)) { \
+            bc_deopt(code, ip); \
+            VM_AGAIN(); \
+        } \
+        exec->stack.stack[--exec->stack.len - 1] = \
+            vnl_value_from_number(num_binop(op, vnl_value_as_number(a), vnl_value_as_number(b))); \
+    } VM_NEXT();
+
+#define VM_QUICK_NUMK(opcode, op) \
+    VM_CASE(opcode): { \
+        Vnl_Value a = exec_stack_peek(exec, 0), b = code->consts[bc_read(&pc)]; \
+        if (!val_is_number(a)) { \
+            bc_deopt(code, ip); \
+            VM_AGAIN(); \
+        } \
+        exec->stack.stack[exec->stack.len - 1] = \
+            vnl_value_from_number(num_binop(op, vnl_value_as_number(a), vnl_value_as_number(b))); \
+    } VM_NEXT();
+
+#define VM_QUICK_LOADNUM(opcode, op) \
+    VM_CASE(opcode): { \
+        Vnl_Value a = exec_stack_peek(exec, 0), b = vnl_vartable_get(exec->vars, code->slots[bc_read(&pc)]); \
+        if (!val_is_number(a) || !val_is_number(b)) { \
+            bc_deopt(code, ip); \
+            VM_AGAIN(); \
+        } \
+        exec->stack.stack[exec->stack.len - 1] = \
+            vnl_value_from_number(num_binop(op, vnl_value_as_number(a), vnl_value_as_number(b))); \
+    } VM_NEXT();
+
+ExecError exec_code(Vnl_Executor *exec, Bytecode *code) {
+#if defined(__GNUC__) && !defined(VNL_SWITCH_DISPATCH)
+    static const void *const DISPATCH[] = {
+        [VM_SET] = &&op_VM_SET,
+        [VM_ADD] = &&op_VM_ADD,
+        [VM_SUB] = &&op_VM_SUB,
+        [VM_MUL] = &&op_VM_MUL,
+        [VM_DIV] = &&op_VM_DIV,
+        [VM_MOD] = &&op_VM_MOD,
+        [VM_LOAD] = &&op_VM_LOAD,
+        [VM_STORE] = &&op_VM_STORE,
+        [VM_ROT] = &&op_VM_ROT,
+        [VM_DUP] = &&op_VM_DUP,
+        [VM_PUT] = &&op_VM_PUT,
+        [VM_MAKEARR] = &&op_VM_MAKEARR,
+        [VM_INDEX] = &&op_VM_INDEX,
+        [VM_SLICE] = &&op_VM_SLICE,
+        [VM_ADDK] = &&op_VM_ADDK,
+        [VM_SUBK] = &&op_VM_SUBK,
+        [VM_MULK] = &&op_VM_MULK,
+        [VM_DIVK] = &&op_VM_DIVK,
+        [VM_MODK] = &&op_VM_MODK,
+        [VM_LOADADD] = &&op_VM_LOADADD,
+        [VM_LOADSUB] = &&op_VM_LOADSUB,
+        [VM_LOADMUL] = &&op_VM_LOADMUL,
+        [VM_LOADDIV] = &&op_VM_LOADDIV,
+        [VM_LOADMOD] = &&op_VM_LOADMOD,
+        [VM_STOREKEEP] = &&op_VM_STOREKEEP,
+        [VM_ADD_NUM] = &&op_VM_ADD_NUM,
+        [VM_SUB_NUM] = &&op_VM_SUB_NUM,
+        [VM_MUL_NUM] = &&op_VM_MUL_NUM,
+        [VM_DIV_NUM] = &&op_VM_DIV_NUM,
+        [VM_MOD_NUM] = &&op_VM_MOD_NUM,
+        [VM_ADDK_NUM] = &&op_VM_ADDK_NUM,
+        [VM_SUBK_NUM] = &&op_VM_SUBK_NUM,
+        [VM_MULK_NUM] = &&op_VM_MULK_NUM,
+        [VM_DIVK_NUM] = &&op_VM_DIVK_NUM,
+        [VM_MODK_NUM] = &&op_VM_MODK_NUM,
+        [VM_LOADADD_NUM] = &&op_VM_LOADADD_NUM,
+        [VM_LOADSUB_NUM] = &&op_VM_LOADSUB_NUM,
+        [VM_LOADMUL_NUM] = &&op_VM_LOADMUL_NUM,
+        [VM_LOADDIV_NUM] = &&op_VM_LOADDIV_NUM,
+        [VM_LOADMOD_NUM] = &&op_VM_LOADMOD_NUM,
+        [VM_ADD_STR] = &&op_VM_ADD_STR,
+        [VM_ADDK_STR] = &&op_VM_ADDK_STR,
+        [VM_LOADADD_STR] = &&op_VM_LOADADD_STR,
+    };
+#endif
+    if (!exec_stack_reserve(exec, code->max_depth)) {
+        return EXEC_ERR;
+    }
+
+    const uint8_t *ip = code->bytes;
+    const uint8_t *pc = ip;
+    const uint8_t *end = code->bytes + code->len;
+
+    for (;;) {
+        if (ip == end) {
+            return EXEC_OK;
+        }
+        if (exec->free_budget) {
+            vnl_object_collect(exec->pool, exec->free_budget);
+        }
+        if (exec->heap.exceeded && exec_heap_over_limit(exec)) {
+            return EXEC_ERR;
+        }
+
+        VM_DISPATCH();
+        switch (VM_FETCH()) {
+            VM_CASE(VM_SET): {
+                // Never emitted by the compiler; a SET in the code means it is corrupt.
+                printf(VNL_ANSICOL_RED "Error: Illegal instruction SET at byte %td\n" VNL_ANSICOL_RESET, ip - code->bytes);
+                return EXEC_ERR;
+            } VM_NEXT();
+
+            VM_CASE(VM_ADD): {
+                Vnl_Value a = exec_stack_pop(exec);
+                Vnl_Value b = exec_stack_pop(exec);
+                bc_quicken(code, ip, a, b);
+                Vnl_Value result;
+                if (exec_binop(exec, BINOP_ADD, a, b, bc_store_target(code, pc), &result)) {
+                    return EXEC_ERR;
+                }
+                exec_stack_give(exec, result);
+            } VM_NEXT();
+
+            VM_CASE(VM_SUB): {
+                Vnl_Value a = exec_stack_pop(exec);
+                Vnl_Value b = exec_stack_pop(exec);
+                bc_quicken(code, ip, a, b);
+                Vnl_Value result;
+                if (exec_binop(exec, BINOP_SUB, a, b, VNL_VARTABLE_NOSLOT, &result)) {
+                    return EXEC_ERR;
+                }
+                exec_stack_give(exec, result);
+            } VM_NEXT();
+
+            VM_CASE(VM_MUL): {
+                Vnl_Value a = exec_stack_pop(exec);
+                Vnl_Value b = exec_stack_pop(exec);
+                bc_quicken(code, ip, a, b);
+                Vnl_Value result;
+                if (exec_binop(exec, BINOP_MUL, a, b, VNL_VARTABLE_NOSLOT, &result)) {
+                    return EXEC_ERR;
+                }
+                exec_stack_give(exec, result);
+            } VM_NEXT();
+
+            VM_CASE(VM_DIV): {
+                Vnl_Value a = exec_stack_pop(exec);
+                Vnl_Value b = exec_stack_pop(exec);
+                bc_quicken(code, ip, a, b);
+                Vnl_Value result;
+                if (exec_binop(exec, BINOP_DIV, a, b, VNL_VARTABLE_NOSLOT, &result)) {
+                    return EXEC_ERR;
+                }
+                exec_stack_give(exec, result);
+            } VM_NEXT();
+
+            VM_CASE(VM_MOD): {
+                Vnl_Value a = exec_stack_pop(exec);
+                Vnl_Value b = exec_stack_pop(exec);
+                bc_quicken(code, ip, a, b);
+                Vnl_Value result;
+                if (exec_binop(exec, BINOP_MOD, a, b, VNL_VARTABLE_NOSLOT, &result)) {
+                    return EXEC_ERR;
+                }
+                exec_stack_give(exec, result);
+            } VM_NEXT();
+
+            VM_CASE(VM_LOAD): {
+                size_t var = bc_read(&pc);
+                Vnl_Value val = vnl_vartable_get(exec->vars, code->slots[var]);
+                if (vnl_value_is_null(val)) {
+                    error_unknown_variable(code->names[var]);
+                    return EXEC_ERR;
+                }
+                exec_stack_push(exec, val);
+            } VM_NEXT();
+
+            VM_CASE(VM_STORE): {
+                size_t var = bc_read(&pc);
+                if (exec_force(exec, &exec->stack.stack[exec->stack.len - 1])) {
+                    return EXEC_ERR;
+                }
+                Vnl_Value val = exec_stack_pop(exec);
+                vnl_vartable_set(exec->vars, code->slots[var], val);
+                vnl_value_release(val);
+            } VM_NEXT();
+
+            VM_CASE(VM_ROT): {
+                Vnl_Value tmp = exec->stack.stack[exec->stack.len - 1];
+                exec->stack.stack[exec->stack.len - 1] = exec->stack.stack[exec->stack.len - 2];
+                exec->stack.stack[exec->stack.len - 2] = tmp;
+            } VM_NEXT();
+
+            VM_CASE(VM_DUP): {
+                exec_stack_push(exec, exec_stack_peek(exec, 0));
+            } VM_NEXT();
+
+            VM_CASE(VM_PUT): {
+                Vnl_Value arg = code->consts[bc_read(&pc)];
+                exec_stack_push(exec, arg);
+            } VM_NEXT();
+
+            VM_CASE(VM_MAKEARR): {
+                size_t arrsize = bc_read(&pc);
+                if (exec_force_all(exec, &exec->stack.stack[exec->stack.len - arrsize], arrsize)) {
+                    return EXEC_ERR;
+                }
+                exec->stack.len -= arrsize;
+                exec_stack_give(exec, exec_make_array(exec, &exec->stack.stack[exec->stack.len], arrsize));
+            } VM_NEXT();
+
+            VM_CASE(VM_INDEX): {
+                Vnl_Value index = exec_stack_pop(exec);
+                Vnl_Value target = exec_stack_pop(exec);
+                Vnl_Value result;
+                if (exec_index(exec, target, index, &result)) {
+                    return EXEC_ERR;
+                }
+                exec_stack_give(exec, result);
+            } VM_NEXT();
+
+            VM_CASE(VM_SLICE): {
+                unsigned parts = bc_read(&pc);
+                exec->stack.len -= 1 + slice_parts_count(parts);
+                Vnl_Value result;
+                if (exec_slice(exec, &exec->stack.stack[exec->stack.len], parts, &result)) {
+                    return EXEC_ERR;
+                }
+                exec_stack_give(exec, result);
+            } VM_NEXT();
+
+            VM_CASE(VM_ADDK): {
+                Vnl_Value arg = code->consts[bc_read(&pc)];
+                bc_quicken(code, ip, exec_stack_peek(exec, 0), arg);
+                vnl_value_acquire(arg);
+                if (exec_binop_top(exec, BINOP_ADD, arg, bc_store_target(code, pc))) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(VM_SUBK): {
+                Vnl_Value arg = code->consts[bc_read(&pc)];
+                bc_quicken(code, ip, exec_stack_peek(exec, 0), arg);
+                vnl_value_acquire(arg);
+                if (exec_binop_top(exec, BINOP_SUB, arg, VNL_VARTABLE_NOSLOT)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(VM_MULK): {
+                Vnl_Value arg = code->consts[bc_read(&pc)];
+                bc_quicken(code, ip, exec_stack_peek(exec, 0), arg);
+                vnl_value_acquire(arg);
+                if (exec_binop_top(exec, BINOP_MUL, arg, VNL_VARTABLE_NOSLOT)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(VM_DIVK): {
+                Vnl_Value arg = code->consts[bc_read(&pc)];
+                bc_quicken(code, ip, exec_stack_peek(exec, 0), arg);
+                vnl_value_acquire(arg);
+                if (exec_binop_top(exec, BINOP_DIV, arg, VNL_VARTABLE_NOSLOT)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(VM_MODK): {
+                Vnl_Value arg = code->consts[bc_read(&pc)];
+                bc_quicken(code, ip, exec_stack_peek(exec, 0), arg);
+                vnl_value_acquire(arg);
+                if (exec_binop_top(exec, BINOP_MOD, arg, VNL_VARTABLE_NOSLOT)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(VM_LOADADD): {
+                size_t var = bc_read(&pc);
+                Vnl_Value b = vnl_vartable_get(exec->vars, code->slots[var]);
+                if (vnl_value_is_null(b)) {
+                    error_unknown_variable(code->names[var]);
+                    return EXEC_ERR;
+                }
+                bc_quicken(code, ip, exec_stack_peek(exec, 0), b);
+                vnl_value_acquire(b);
+                if (exec_binop_top(exec, BINOP_ADD, b, bc_store_target(code, pc))) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(VM_LOADSUB): {
+                size_t var = bc_read(&pc);
+                Vnl_Value b = vnl_vartable_get(exec->vars, code->slots[var]);
+                if (vnl_value_is_null(b)) {
+                    error_unknown_variable(code->names[var]);
+                    return EXEC_ERR;
+                }
+                bc_quicken(code, ip, exec_stack_peek(exec, 0), b);
+                vnl_value_acquire(b);
+                if (exec_binop_top(exec, BINOP_SUB, b, VNL_VARTABLE_NOSLOT)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(VM_LOADMUL): {
+                size_t var = bc_read(&pc);
+                Vnl_Value b = vnl_vartable_get(exec->vars, code->slots[var]);
+                if (vnl_value_is_null(b)) {
+                    error_unknown_variable(code->names[var]);
+                    return EXEC_ERR;
+                }
+                bc_quicken(code, ip, exec_stack_peek(exec, 0), b);
+                vnl_value_acquire(b);
+                if (exec_binop_top(exec, BINOP_MUL, b, VNL_VARTABLE_NOSLOT)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(VM_LOADDIV): {
+                size_t var = bc_read(&pc);
+                Vnl_Value b = vnl_vartable_get(exec->vars, code->slots[var]);
+                if (vnl_value_is_null(b)) {
+                    error_unknown_variable(code->names[var]);
+                    return EXEC_ERR;
+                }
+                bc_quicken(code, ip, exec_stack_peek(exec, 0), b);
+                vnl_value_acquire(b);
+                if (exec_binop_top(exec, BINOP_DIV, b, VNL_VARTABLE_NOSLOT)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(VM_LOADMOD): {
+                size_t var = bc_read(&pc);
+                Vnl_Value b = vnl_vartable_get(exec->vars, code->slots[var]);
+                if (vnl_value_is_null(b)) {
+                    error_unknown_variable(code->names[var]);
+                    return EXEC_ERR;
+                }
+                bc_quicken(code, ip, exec_stack_peek(exec, 0), b);
+                vnl_value_acquire(b);
+                if (exec_binop_top(exec, BINOP_MOD, b, VNL_VARTABLE_NOSLOT)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(VM_STOREKEEP): {
+                size_t var = bc_read(&pc);
+                if (exec_force(exec, &exec->stack.stack[exec->stack.len - 1])) {
+                    return EXEC_ERR;
+                }
+                vnl_vartable_set(exec->vars, code->slots[var], exec_stack_peek(exec, 0));
+            } VM_NEXT();
+
+            VM_QUICK_NUM(VM_ADD_NUM, BINOP_ADD)
+            VM_QUICK_NUM(VM_SUB_NUM, BINOP_SUB)
+            VM_QUICK_NUM(VM_MUL_NUM, BINOP_MUL)
+            VM_QUICK_NUM(VM_DIV_NUM, BINOP_DIV)
+            VM_QUICK_NUM(VM_MOD_NUM, BINOP_MOD)
+            VM_QUICK_NUMK(VM_ADDK_NUM, BINOP_ADD)
+            VM_QUICK_NUMK(VM_SUBK_NUM, BINOP_SUB)
+            VM_QUICK_NUMK(VM_MULK_NUM, BINOP_MUL)
+            VM_QUICK_NUMK(VM_DIVK_NUM, BINOP_DIV)
+            VM_QUICK_NUMK(VM_MODK_NUM, BINOP_MOD)
+            VM_QUICK_LOADNUM(VM_LOADADD_NUM, BINOP_ADD)
+            VM_QUICK_LOADNUM(VM_LOADSUB_NUM, BINOP_SUB)
+            VM_QUICK_LOADNUM(VM_LOADMUL_NUM, BINOP_MUL)
+            VM_QUICK_LOADNUM(VM_LOADDIV_NUM, BINOP_DIV)
+            VM_QUICK_LOADNUM(VM_LOADMOD_NUM, BINOP_MOD)
+
+            VM_CASE(VM_ADD_STR): {
+                Vnl_Value a = exec_stack_peek(exec, 0), b = exec_stack_peek(exec, 1);
+                if (!val_is_string(a) || !val_is_string(b)) {
+                    bc_deopt(code, ip);
+                    VM_AGAIN();
+                }
+                exec->stack.len -= 2;
+                Vnl_Value result;
+                if (exec_string_concat(exec, a, b, bc_store_target(code, pc), &result)) {
+                    return EXEC_ERR;
+                }
+                exec_stack_give(exec, result);
+            } VM_NEXT();
+
+            VM_CASE(VM_ADDK_STR): {
+                Vnl_Value a = exec_stack_peek(exec, 0), arg = code->consts[bc_read(&pc)];
+                if (!val_is_string(a)) {
+                    bc_deopt(code, ip);
+                    VM_AGAIN();
+                }
+                exec->stack.len--;
+                vnl_value_acquire(arg);
+                Vnl_Value result;
+                if (exec_string_concat(exec, a, arg, bc_store_target(code, pc), &result)) {
+                    return EXEC_ERR;
+                }
+                exec_stack_give(exec, result);
+            } VM_NEXT();
+
+            VM_CASE(VM_LOADADD_STR): {
+                Vnl_Value a = exec_stack_peek(exec, 0), b = vnl_vartable_get(exec->vars, code->slots[bc_read(&pc)]);
+                if (!val_is_string(a) || !val_is_string(b)) {
+                    bc_deopt(code, ip);
+                    VM_AGAIN();
+                }
+                exec->stack.len--;
+                vnl_value_acquire(b);
+                Vnl_Value result;
+                if (exec_string_concat(exec, a, b, bc_store_target(code, pc), &result)) {
+                    return EXEC_ERR;
+                }
+                exec_stack_give(exec, result);
+            } VM_NEXT();
+
+        }
+    }
+}
+
+
+
+// Fetches an operand as an owned value. Operand registers are temporaries that are
+// never read twice, so their value is moved out rather than shared.
+ExecError reg_fetch(Vnl_Executor *exec, const RegOperand *opnd, Vnl_Value *val) {
+    switch (opnd->kind) {
+        case OPND_REG: {
+            *val = exec->regs[opnd->reg];
+            exec->regs[opnd->reg] = VNL_NULL;
+        } break;
+
+        case OPND_CONST: {
+            *val = opnd->value;
+            vnl_value_acquire(*val);
+        } break;
+
+        case OPND_VAR: {
+            *val = vnl_vartable_get(exec->vars, opnd->slot);
+            if (vnl_value_is_null(*val)) {
+                error_unknown_variable(opnd->varname);
+                return EXEC_ERR;
+            }
+            vnl_value_acquire(*val);
+        } break;
+    }
+    return EXEC_OK;
+}
+
+// Takes over the caller's reference to `val`.
+void reg_set(Vnl_Executor *exec, Reg reg, Vnl_Value val) {
+    vnl_value_release(exec->regs[reg]);
+    exec->regs[reg] = val;
+}
+
+// In register code the pattern is ADD rN, ...; STORE s, rN.
+size_t regcode_store_target(const RegCode *code, const RegInstruction *ip) {
+    if (ip + 1 >= code->items + code->len) {
+        return VNL_VARTABLE_NOSLOT;
+    }
+    if (ip[1].opcode != RVM_STORE || ip[1].a.reg != ip->dst) {
+        return VNL_VARTABLE_NOSLOT;
+    }
+    return ip[1].slot;
+}
+
+ExecError reg_binop(Vnl_Executor *exec, const RegCode *code, const RegInstruction *ip, OpKind op) {
+    Vnl_Value a, b, result;
+    if (reg_fetch(exec, &ip->a, &a)) {
+        return EXEC_ERR;
+    }
+    if (reg_fetch(exec, &ip->b, &b)) {
+        vnl_value_release(a);
+        return EXEC_ERR;
+    }
+    size_t target = op == BINOP_ADD ? regcode_store_target(code, ip) : VNL_VARTABLE_NOSLOT;
+    if (exec_binop(exec, op, a, b, target, &result)) {
+        return EXEC_ERR;
+    }
+    reg_set(exec, ip->dst, result);
+    return EXEC_OK;
+}
+
+#undef VM_FETCH
+#undef VM_ADVANCE
+#define VM_FETCH() ip->opcode
+#define VM_ADVANCE() (++ip)
+
+ExecError exec_regcode_dispatch(Vnl_Executor *exec, const RegCode *code) {
+#if defined(__GNUC__) && !defined(VNL_SWITCH_DISPATCH)
+    static const void *const DISPATCH[] = {
+        [RVM_ADD] = &&op_RVM_ADD,
+        [RVM_SUB] = &&op_RVM_SUB,
+        [RVM_MUL] = &&op_RVM_MUL,
+        [RVM_DIV] = &&op_RVM_DIV,
+        [RVM_MOD] = &&op_RVM_MOD,
+        [RVM_INDEX] = &&op_RVM_INDEX,
+        [RVM_MOVE] = &&op_RVM_MOVE,
+        [RVM_STORE] = &&op_RVM_STORE,
+        [RVM_MAKEARR] = &&op_RVM_MAKEARR,
+        [RVM_SLICE] = &&op_RVM_SLICE,
+        [RVM_RET] = &&op_RVM_RET,
+    };
+#endif
+    const RegInstruction *ip = code->items;
+    const RegInstruction *end = code->items + code->len;
+
+    for (;;) {
+        if (ip == end) {
+            return EXEC_OK;
+        }
+        if (exec->free_budget) {
+            vnl_object_collect(exec->pool, exec->free_budget);
+        }
+        if (exec->heap.exceeded && exec_heap_over_limit(exec)) {
+            return EXEC_ERR;
+        }
+
+        VM_DISPATCH();
+        switch (VM_FETCH()) {
+            VM_CASE(RVM_ADD): {
+                if (reg_binop(exec, code, ip, BINOP_ADD)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(RVM_SUB): {
+                if (reg_binop(exec, code, ip, BINOP_SUB)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(RVM_MUL): {
+                if (reg_binop(exec, code, ip, BINOP_MUL)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(RVM_DIV): {
+                if (reg_binop(exec, code, ip, BINOP_DIV)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(RVM_MOD): {
+                if (reg_binop(exec, code, ip, BINOP_MOD)) {
+                    return EXEC_ERR;
+                }
+            } VM_NEXT();
+
+            VM_CASE(RVM_MOVE): {
+                Vnl_Value val;
+                if (reg_fetch(exec, &ip->a, &val)) {
+                    return EXEC_ERR;
+                }
+                reg_set(exec, ip->dst, val);
+            } VM_NEXT();
+
+            VM_CASE(RVM_STORE): {
+                if (exec_force(exec, &exec->regs[ip->a.reg])) {
+                    return EXEC_ERR;
+                }
+                vnl_vartable_set(exec->vars, ip->slot, exec->regs[ip->a.reg]);
+            } VM_NEXT();
+
+            VM_CASE(RVM_MAKEARR): {
+                if (exec_force_all(exec, &exec->regs[ip->a.reg], ip->makearr_len)) {
+                    return EXEC_ERR;
+                }
+                Vnl_Value val = exec_make_array(exec, &exec->regs[ip->a.reg], ip->makearr_len);
+                for (size_t i = 0; i < ip->makearr_len; ++i) {
+                    exec->regs[ip->a.reg + i] = VNL_NULL;
+                }
+                reg_set(exec, ip->dst, val);
+            } VM_NEXT();
+
+            VM_CASE(RVM_INDEX): {
+                Vnl_Value target, index, result;
+                if (reg_fetch(exec, &ip->a, &target)) {
+                    return EXEC_ERR;
+                }
+                if (reg_fetch(exec, &ip->b, &index)) {
+                    vnl_value_release(target);
+                    return EXEC_ERR;
+                }
+                if (exec_index(exec, target, index, &result)) {
+                    return EXEC_ERR;
                 }
-                exec_stack_push(exec, obj);
-            } break;
-
-            case VM_STORE: {
-                Vnl_String varname = instr.varname;
-                Vnl_Object *obj = exec_stack_pop(exec);
-                if (!obj) {
-                    printf(VNL_ANSICOL_RED "Error: No value to store - stack is empty!\n" VNL_ANSICOL_RESET);
+                reg_set(exec, ip->dst, result);
+            } VM_NEXT();
+
+            VM_CASE(RVM_SLICE): {
+                Vnl_Value result;
+                ExecError err = exec_slice(exec, &exec->regs[ip->a.reg], ip->slice_parts, &result);
+                for (size_t i = 0; i <= slice_parts_count(ip->slice_parts); ++i) {
+                    exec->regs[ip->a.reg + i] = VNL_NULL;
+                }
+                if (err) {
                     return EXEC_ERR;
                 }
-                vnl_exec_setvar(exec, varname, obj);
-            } break;
+                reg_set(exec, ip->dst, result);
+            } VM_NEXT();
 
-            case VM_ROT: {
-               if (exec->stack.len < 2) {
-                   printf(VNL_ANSICOL_RED "Error: not enough values to ROT!");
-                   return EXEC_ERR;
-               }
-               Vnl_Object *tmp = exec->stack.stack[exec->stack.len - 1];
-               exec->stack.stack[exec->stack.len - 1] = exec->stack.stack[exec->stack.len - 2];
-               exec->stack.stack[exec->stack.len - 2] = tmp;
-            } break;
+            VM_CASE(RVM_RET): {
+                exec_stack_give(exec, exec->regs[ip->a.reg]);
+                exec->regs[ip->a.reg] = VNL_NULL;
+            } VM_NEXT();
+        }
+    }
+}
 
-            case VM_DUP: {
-                if (!exec->stack.len) {
-                    printf(VNL_ANSICOL_RED "Error: Cannot DUP - stack is empty!\n" VNL_ANSICOL_RESET);
-                    return EXEC_ERR;
-                } else {
-                    exec_stack_push(exec, exec->stack.stack[exec->stack.len-1]);
+#undef VM_CASE
+#undef VM_DISPATCH
+#undef VM_NEXT
+#undef VM_FETCH
+#undef VM_ADVANCE
+#undef VM_AGAIN
+#undef VM_QUICK_NUM
+#undef VM_QUICK_NUMK
+#undef VM_QUICK_LOADNUM
+
+ExecError exec_regcode(Vnl_Executor *exec, const RegCode *code) {
+    // RET leaves the statement's value on the VM stack.
+    if (!exec_stack_reserve(exec, 1)) {
+        return EXEC_ERR;
+    }
+    if (exec->regs_cap < code->nregs) {
+        exec->regs = vnl_realloc(exec->regs, code->nregs * sizeof(*exec->regs));
+        for (size_t i = exec->regs_cap; i < code->nregs; ++i) {
+            exec->regs[i] = VNL_NULL;
+        }
+        exec->regs_cap = code->nregs;
+    }
+    ExecError err = exec_regcode_dispatch(exec, code);
+    // Only an error can leave temporaries behind.
+    for (size_t i = 0; err && i < code->nregs; ++i) {
+        reg_set(exec, i, VNL_NULL);
+    }
+    return err;
+}
+
+
+// Folded strings are built once per compile and kept by the code, so longer results are
+// left to the runtime ropes.
+static const size_t FOLD_STRING_LIMIT = 1024;
+
+typedef enum {
+    STATICTYPE_UNKNOWN,
+    STATICTYPE_NUMBER,
+    STATICTYPE_STRING,
+    STATICTYPE_ARRAY,
+    // A number or an array of them, which is all arithmetic other than `+` and `*` yields.
+    STATICTYPE_NUMERIC,
+} StaticType;
+
+bool static_type_is_numeric(StaticType type) {
+    return type == STATICTYPE_NUMBER || type == STATICTYPE_NUMERIC;
+}
+
+// The type an expression evaluates to whenever it doesn't fail.
+StaticType ast_static_type(const ASTNode *ast) {
+    switch (ast->_ast_type) {
+        case ASTTYPE_NUMLIT: return STATICTYPE_NUMBER;
+        case ASTTYPE_STRLIT: return STATICTYPE_STRING;
+        case ASTTYPE_ARRAY_LITERAL: return STATICTYPE_ARRAY;
+        case ASTTYPE_SLICE: return STATICTYPE_ARRAY;
+
+        case ASTTYPE_CONST: {
+            const ASTNode_Const *astnode = (void *)ast;
+            if (val_is_number(astnode->value)) return STATICTYPE_NUMBER;
+            if (val_is_string(astnode->value)) return STATICTYPE_STRING;
+            return STATICTYPE_ARRAY;
+        }
+
+        case ASTTYPE_BINOP: {
+            const ASTNode_BinOp *astnode = (void *)ast;
+            StaticType lhs = ast_static_type(astnode->lhs);
+            StaticType rhs = ast_static_type(astnode->rhs);
+            switch (astnode->op) {
+                case BINOP_SET:
+                    return rhs;
+                case BINOP_SUB:
+                case BINOP_DIV:
+                case BINOP_MOD:
+                    if (lhs == STATICTYPE_NUMBER && rhs == STATICTYPE_NUMBER) return STATICTYPE_NUMBER;
+                    return STATICTYPE_NUMERIC;
+                case BINOP_ADD:
+                case BINOP_MUL:
+                    if (lhs == STATICTYPE_NUMBER && rhs == STATICTYPE_NUMBER) return STATICTYPE_NUMBER;
+                    if (static_type_is_numeric(lhs) && static_type_is_numeric(rhs)) return STATICTYPE_NUMERIC;
+                    if (lhs == STATICTYPE_ARRAY || rhs == STATICTYPE_ARRAY) return STATICTYPE_ARRAY;
+                    if (lhs == STATICTYPE_NUMERIC || rhs == STATICTYPE_NUMERIC) return STATICTYPE_UNKNOWN;
+                    if (lhs == STATICTYPE_STRING || rhs == STATICTYPE_STRING) return STATICTYPE_STRING;
+                    return STATICTYPE_UNKNOWN;
+            }
+            return STATICTYPE_UNKNOWN;
+        }
+
+        default:
+            return STATICTYPE_UNKNOWN;
+    }
+}
+
+bool ast_is_constant(const ASTNode *ast) {
+    return ast->_ast_type == ASTTYPE_NUMLIT
+        || ast->_ast_type == ASTTYPE_STRLIT
+        || ast->_ast_type == ASTTYPE_CONST;
+}
+
+bool ast_as_number(const ASTNode *ast, double *num) {
+    if (ast->_ast_type == ASTTYPE_NUMLIT) {
+        *num = ((const ASTNode_Numlit *)ast)->value;
+        return true;
+    }
+    if (ast->_ast_type == ASTTYPE_CONST && val_is_number(((const ASTNode_Const *)ast)->value)) {
+        *num = vnl_value_as_number(((const ASTNode_Const *)ast)->value);
+        return true;
+    }
+    return false;
+}
+
+bool ast_as_string(const ASTNode *ast, Vnl_String *str) {
+    if (ast->_ast_type == ASTTYPE_STRLIT) {
+        *str = ((const ASTNode_Strlit *)ast)->value;
+        return true;
+    }
+    if (ast->_ast_type == ASTTYPE_CONST && val_is_string(((const ASTNode_Const *)ast)->value)) {
+        *str = vnl_strobj_flatten((void *)vnl_value_as_object(((const ASTNode_Const *)ast)->value));
+        return true;
+    }
+    return false;
+}
+
+// Hands out an owned reference to the value of a constant node, which is used up.
+Vnl_Value ast_take_constant(Vnl_Executor *exec, const ASTNode *ast) {
+    Vnl_Value val;
+    switch (ast->_ast_type) {
+        case ASTTYPE_NUMLIT:
+            return vnl_value_from_number(((const ASTNode_Numlit *)ast)->value);
+        case ASTTYPE_STRLIT:
+            val = vnl_value_from_object((Vnl_Object *)vnl_strobj_new(exec->pool, ((const ASTNode_Strlit *)ast)->value));
+            vnl_value_acquire(val);
+            return val;
+        default:
+            return ((const ASTNode_Const *)ast)->value;
+    }
+}
+
+void ast_release_constant(const ASTNode *ast) {
+    if (ast->_ast_type == ASTTYPE_CONST) {
+        vnl_value_release(((const ASTNode_Const *)ast)->value);
+    }
+}
+
+ASTNode *ast_new_numlit(Vnl_Arena *arena, double value) {
+    ASTNode_Numlit *numlit = vnl_arena_alloc(arena, sizeof(*numlit));
+    *numlit = (ASTNode_Numlit){ { ASTTYPE_NUMLIT, RVALUE }, value };
+    return (ASTNode *)numlit;
+}
+
+// Takes over the reference to `value`.
+ASTNode *ast_new_const(Vnl_Arena *arena, Vnl_Value value) {
+    ASTNode_Const *constant = vnl_arena_alloc(arena, sizeof(*constant));
+    *constant = (ASTNode_Const){ { ASTTYPE_CONST, RVALUE }, value };
+    return (ASTNode *)constant;
+}
+
+ASTNode *ast_new_string(Vnl_Executor *exec, Vnl_StringObject *str) {
+    Vnl_Value val = vnl_value_from_object((Vnl_Object *)str);
+    vnl_value_acquire(val);
+    return ast_new_const(&exec->arena, val);
+}
+
+// Evaluates an operation on two constants, or returns nullptr if it has to be left to the
+// runtime - because it fails there, or because the result would be too big to keep.
+ASTNode *ast_fold_constants(Vnl_Executor *exec, OpKind op, const ASTNode *lhs, const ASTNode *rhs) {
+    double x, y;
+    Vnl_String a, b;
+    if (ast_as_number(lhs, &x) && ast_as_number(rhs, &y)) {
+        switch (op) {
+            case BINOP_ADD: return ast_new_numlit(&exec->arena, x + y);
+            case BINOP_SUB: return ast_new_numlit(&exec->arena, x - y);
+            case BINOP_MUL: return ast_new_numlit(&exec->arena, x * y);
+            case BINOP_DIV: return ast_new_numlit(&exec->arena, x / y);
+            case BINOP_MOD: return ast_new_numlit(&exec->arena, fmod(x, y));
+            default: return nullptr;
+        }
+    }
+
+    if (op == BINOP_ADD && ast_as_string(lhs, &a) && ast_as_string(rhs, &b)) {
+        if (a.len + b.len > FOLD_STRING_LIMIT) {
+            return nullptr;
+        }
+        Vnl_StringObject *str = vnl_strobj_new(exec->pool, a);
+        vnl_strobj_append(str, b);
+        return ast_new_string(exec, str);
+    }
+
+    if (op == BINOP_MUL) {
+        bool lhs_is_string = ast_as_string(lhs, &a);
+        if (!(lhs_is_string ? ast_as_number(rhs, &y) : ast_as_string(rhs, &a) && ast_as_number(lhs, &y))) {
+            return nullptr;
+        }
+        if (!is_repeat_count(y) || (a.len && y > FOLD_STRING_LIMIT / a.len)) {
+            return nullptr;
+        }
+        size_t times = a.len ? (size_t)y : 0;
+        Vnl_StringObject *str = vnl_strobj_new(exec->pool, (Vnl_String){ nullptr, 0 });
+        vnl_strbuf_reserve_exact(&str->value, a.len * times);
+        for (size_t i = 0; i < times; ++i) {
+            vnl_strobj_append(str, a);
+        }
+        return ast_new_string(exec, str);
+    }
+
+    return nullptr;
+}
+
+bool ast_is_number_equal(const ASTNode *ast, double value) {
+    double num;
+    return ast_as_number(ast, &num) && num == value && !signbit(num);
+}
+
+bool ast_is_empty_string(const ASTNode *ast) {
+    Vnl_String str;
+    return ast_as_string(ast, &str) && str.len == 0;
+}
+
+// Drops the constant side of an operation that can't change the other one. Only applied
+// when the type of that side is known, since e.g. `x - 0` is an error for strings.
+ASTNode *ast_fold_identity(const ASTNode_BinOp *binop) {
+    StaticType lhs = ast_static_type(binop->lhs);
+    StaticType rhs = ast_static_type(binop->rhs);
+
+    // `x + 0` is left alone: it turns -0 into 0.
+    if (static_type_is_numeric(lhs)) {
+        if ((binop->op == BINOP_SUB && ast_is_number_equal(binop->rhs, 0))
+            || (binop->op == BINOP_MUL && ast_is_number_equal(binop->rhs, 1))
+            || (binop->op == BINOP_DIV && ast_is_number_equal(binop->rhs, 1))) {
+            return binop->lhs;
+        }
+    }
+    if (static_type_is_numeric(rhs) && binop->op == BINOP_MUL && ast_is_number_equal(binop->lhs, 1)) {
+        return binop->rhs;
+    }
+
+    if (lhs == STATICTYPE_STRING) {
+        if ((binop->op == BINOP_ADD && ast_is_empty_string(binop->rhs))
+            || (binop->op == BINOP_MUL && ast_is_number_equal(binop->rhs, 1))) {
+            ast_release_constant(binop->rhs);
+            return binop->lhs;
+        }
+    }
+    if (rhs == STATICTYPE_STRING) {
+        if ((binop->op == BINOP_ADD && ast_is_empty_string(binop->lhs))
+            || (binop->op == BINOP_MUL && ast_is_number_equal(binop->lhs, 1))) {
+            ast_release_constant(binop->lhs);
+            return binop->rhs;
+        }
+    }
+    return nullptr;
+}
+
+// Constant folding between parsing and compilation. Subtrees made only of literals are
+// evaluated here, and arrays of constants are built up front, so the VM sees a single PUT.
+ASTNode *ast_fold(Vnl_Executor *exec, ASTNode *ast) {
+    switch (ast->_ast_type) {
+        case ASTTYPE_BINOP: {
+            ASTNode_BinOp *astnode = (void *)ast;
+            astnode->rhs = ast_fold(exec, astnode->rhs);
+            if (astnode->op == BINOP_SET) {
+                return ast;
+            }
+            astnode->lhs = ast_fold(exec, astnode->lhs);
+
+            if (ast_is_constant(astnode->lhs) && ast_is_constant(astnode->rhs)) {
+                ASTNode *folded = ast_fold_constants(exec, astnode->op, astnode->lhs, astnode->rhs);
+                if (folded) {
+                    ast_release_constant(astnode->lhs);
+                    ast_release_constant(astnode->rhs);
+                    return folded;
                 }
-            } break;
+            }
+            ASTNode *simplified = ast_fold_identity(astnode);
+            return simplified ? simplified : ast;
+        }
 
-            case VM_PUT: {
-                exec_stack_push(exec, instr.arg);
-            } break;
+        case ASTTYPE_ARRAY_LITERAL: {
+            ASTNode_ArrayLiteral *astnode = (void *)ast;
+            bool constant = true;
+            for (size_t i = 0; i < astnode->len; ++i) {
+                astnode->items[i] = ast_fold(exec, astnode->items[i]);
+                constant = constant && ast_is_constant(astnode->items[i]);
+            }
+            if (!constant) {
+                return ast;
+            }
+            Vnl_Value *items = vnl_arena_alloc(&exec->arena, sizeof(*items) * (astnode->len ? astnode->len : 1));
+            for (size_t i = 0; i < astnode->len; ++i) {
+                items[i] = ast_take_constant(exec, astnode->items[i]);
+            }
+            return ast_new_const(&exec->arena, exec_make_array(exec, items, astnode->len));
+        }
 
-            case VM_MAKEARR: {
-                size_t arrsize = instr.makearr_len;
-                Vnl_ArrayObject *arr = vnl_object_create(sizeof(*arr), VNL_OBJTYPE_ARRAY);
-                for (size_t i = 0; i < arrsize; ++i) {
-                    Vnl_Object *obj = exec_stack_pop(exec);
-                    obj_array_push(arr, obj);
-                }
-                obj_arr_reverse(arr);
-                exec_stack_push(exec, (Vnl_Object *)arr);
-            } break;
+        case ASTTYPE_INDEX: {
+            ASTNode_Index *astnode = (void *)ast;
+            astnode->target = ast_fold(exec, astnode->target);
+            astnode->index = ast_fold(exec, astnode->index);
+            return ast;
+        }
 
+        case ASTTYPE_SLICE: {
+            ASTNode_Slice *astnode = (void *)ast;
+            ASTNode **children[] = { &astnode->target, &astnode->start, &astnode->stop, &astnode->step };
+            for (size_t i = 0; i < 4; ++i) {
+                if (*children[i]) {
+                    *children[i] = ast_fold(exec, *children[i]);
+                }
+            }
+            return ast;
         }
+
+        default:
+            return ast;
     }
-    return EXEC_OK;
 }
 
 
-void exec_compile_ast(Vnl_Executor *exec, const ASTNode *ast, Code *compile_result) {
+
+unsigned ast_slice_parts(const ASTNode_Slice *slice) {
+    return (slice->start ? SLICE_START : 0) | (slice->stop ? SLICE_STOP : 0) | (slice->step ? SLICE_STEP : 0);
+}
+
+// Appends the code for `ast`. On errors the code is left unfinished, and the caller frees it.
+ParseError exec_compile_ast(Vnl_Executor *exec, const ASTNode *ast, Code *compile_result) {
+    ParseError err = PARSEERR_OK;
     switch (ast->_ast_type) {
         case ASTTYPE_NUMLIT: {
             const ASTNode_Numlit *astnode = (void *)ast;
-            Vnl_NumberObject *obj = exec_create_number(exec, astnode->value);
-            Instruction instr = { VM_PUT, .arg = (Vnl_Object *)obj };
+            Instruction instr = { VM_PUT, .arg = vnl_value_from_number(astnode->value) };
             code_append(compile_result, instr);
         } break;
 
         case ASTTYPE_IDENT: {
             const ASTNode_Ident *astnode = (void *)ast;
-            Vnl_String varname = vnl_string_from_b(&astnode->value);
-            Instruction instr = { VM_LOAD, .varname = varname };
+            Instruction instr = { VM_LOAD, .varname = astnode->value, .slot = vnl_vartable_resolve(exec->vars, astnode->value) };
             code_append(compile_result, instr);
         } break;
 
         case ASTTYPE_STRLIT: {
             const ASTNode_Strlit *astnode = (void *)ast;
-            Vnl_StringObject *str = vnl_object_create(sizeof(*str), VNL_OBJTYPE_STRING);
-            vnl_strbuf_append_s(&str->value, vnl_string_from_b(&astnode->value));
-            Instruction instr = { VM_PUT, .arg = (Vnl_Object *)str };
+            Vnl_StringObject *str = vnl_strobj_new(exec->pool, astnode->value);
+            Vnl_Value val = vnl_value_from_object((Vnl_Object *)str);
+            vnl_value_acquire(val);
+            Instruction instr = { VM_PUT, .arg = val };
             code_append(compile_result, instr);
         } break;
 
@@ -1259,18 +3525,21 @@ void exec_compile_ast(Vnl_Executor *exec, const ASTNode *ast, Code *compile_resu
             Instruction instr;
             if (astnode->op == BINOP_SET) {
                 if (astnode->lhs->_ast_type != ASTTYPE_IDENT) {
-                    printf(VNL_ANSICOL_RED "Error: Not assignable!" VNL_ANSICOL_RESET);
-                    exit(1);
+                    return PARSEERR_AST_NOT_ASSIGNABLE;
                 }
                 const ASTNode_Ident *ident = (void *)astnode->lhs;
-                Vnl_String varname = vnl_string_from_b(&ident->value);
-                exec_compile_ast(exec, astnode->rhs, compile_result);
+                const Vnl_Symbol *varname = ident->value;
+                if ((err = exec_compile_ast(exec, astnode->rhs, compile_result))) {
+                    return err;
+                }
                 instr = (Instruction){ VM_DUP };
                 code_append(compile_result, instr);
-                instr = (Instruction){ VM_STORE, .varname = varname };
+                instr = (Instruction){ VM_STORE, .varname = varname, .slot = vnl_vartable_resolve(exec->vars, varname) };
             } else {
-                exec_compile_ast(exec, astnode->lhs, compile_result);
-                exec_compile_ast(exec, astnode->rhs, compile_result);
+                if ((err = exec_compile_ast(exec, astnode->lhs, compile_result))
+                    || (err = exec_compile_ast(exec, astnode->rhs, compile_result))) {
+                    return err;
+                }
                 instr = (Instruction){ VM_ROT };
                 code_append(compile_result, instr);
                 instr = (Instruction){ (VMOpcode)astnode->op };
@@ -1279,20 +3548,382 @@ void exec_compile_ast(Vnl_Executor *exec, const ASTNode *ast, Code *compile_resu
         } break;
 
         case ASTTYPE_CALL: {
-            printf(VNL_ANSICOL_RED "TODO" VNL_ANSICOL_RESET);
-            exit(1);
+            return PARSEERR_AST_UNSUPPORTED_CALL;
         } break;
 
         case ASTTYPE_ARRAY_LITERAL: {
             const ASTNode_ArrayLiteral *astnode = (void *)ast;
             for (size_t i = 0; i < astnode->len; ++i) {
                 ASTNode *item = astnode->items[i];
-                exec_compile_ast(exec, item, compile_result);
+                if ((err = exec_compile_ast(exec, item, compile_result))) {
+                    return err;
+                }
             }
             Instruction instr = { VM_MAKEARR, .makearr_len = astnode->len };
             code_append(compile_result, instr);
         } break;
+
+        case ASTTYPE_CONST: {
+            const ASTNode_Const *astnode = (void *)ast;
+            Instruction instr = { VM_PUT, .arg = astnode->value };
+            code_append(compile_result, instr);
+        } break;
+
+        case ASTTYPE_INDEX: {
+            const ASTNode_Index *astnode = (void *)ast;
+            if ((err = exec_compile_ast(exec, astnode->target, compile_result))
+                || (err = exec_compile_ast(exec, astnode->index, compile_result))) {
+                return err;
+            }
+            code_append(compile_result, (Instruction){ VM_INDEX });
+        } break;
+
+        case ASTTYPE_SLICE: {
+            const ASTNode_Slice *astnode = (void *)ast;
+            const ASTNode *bounds[] = { astnode->start, astnode->stop, astnode->step };
+            if ((err = exec_compile_ast(exec, astnode->target, compile_result))) {
+                return err;
+            }
+            for (size_t i = 0; i < 3; ++i) {
+                if (bounds[i] && (err = exec_compile_ast(exec, bounds[i], compile_result))) {
+                    return err;
+                }
+            }
+            code_append(compile_result, (Instruction){ VM_SLICE, .slice_parts = ast_slice_parts(astnode) });
+        } break;
     } // switch (ast->_ast_type)
+    return err;
+}
+
+
+
+// Net number of values an instruction leaves on the stack.
+ptrdiff_t code_stack_effect(const Instruction *instr) {
+    switch (instr->opcode) {
+        case VM_PUT:
+        case VM_LOAD:
+        case VM_DUP:
+            return 1;
+        case VM_ADD:
+        case VM_SUB:
+        case VM_MUL:
+        case VM_DIV:
+        case VM_MOD:
+        case VM_STORE:
+        case VM_INDEX:
+            return -1;
+        case VM_MAKEARR:
+            return 1 - (ptrdiff_t)instr->makearr_len;
+        case VM_SLICE:
+            return -(ptrdiff_t)slice_parts_count(instr->slice_parts);
+        default:
+            return 0;
+    }
+}
+
+// Start of the instructions in [0, end) that compute the last value pushed before `end`.
+size_t code_operand_start(const Code *code, size_t end) {
+    ptrdiff_t depth = 0;
+    for (size_t i = end; i-- > 0;) {
+        depth += code_stack_effect(&code->items[i]);
+        if (depth == 1) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+bool code_span_is_constant(const Code *code, size_t start, size_t end) {
+    for (size_t i = start; i < end; ++i) {
+        if (code->items[i].opcode != VM_PUT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Tries to drop the ROT in front of the binop about to be appended to `out` by emitting
+// the right operand before the left one instead. Only done when one operand is made of
+// constants: then neither side can observe the other's side effects or errors.
+bool code_swap_operands(Code *out) {
+    size_t rhs = code_operand_start(out, out->len);
+    if (rhs == SIZE_MAX) {
+        return false;
+    }
+    size_t lhs = code_operand_start(out, rhs);
+    if (lhs == SIZE_MAX) {
+        return false;
+    }
+    if (!code_span_is_constant(out, lhs, rhs) && !code_span_is_constant(out, rhs, out->len)) {
+        return false;
+    }
+
+    size_t lhs_len = rhs - lhs;
+    Instruction *tmp = vnl_malloc(lhs_len * sizeof(*tmp));
+    memcpy(tmp, out->items + lhs, lhs_len * sizeof(*tmp));
+    memmove(out->items + lhs, out->items + rhs, (out->len - rhs) * sizeof(*tmp));
+    memcpy(out->items + out->len - lhs_len, tmp, lhs_len * sizeof(*tmp));
+    vnl_free(tmp);
+    return true;
+}
+
+// Peephole pass over freshly compiled code:
+//   PUT k, ROT, op      -> opK k
+//   LOAD x, ROT, op     -> LOADop x
+//   <a>, <b>, ROT, op   -> <b>, <a>, op      (when <a> or <b> is constant)
+//   DUP, STORE x        -> STOREKEEP x
+// Takes ownership of the constants in `code`, which is left empty.
+void code_optimize(Code *code) {
+    Code out = {0};
+    const Instruction *items = code->items;
+    size_t len = code->len;
+
+    for (size_t i = 0; i < len; ++i) {
+        Instruction instr = items[i];
+        bool fused_operand = i + 2 < len
+            && items[i + 1].opcode == VM_ROT
+            && vm_opcode_is_binop(items[i + 2].opcode);
+
+        if (fused_operand && instr.opcode == VM_PUT) {
+            code_append(&out, (Instruction){ items[i + 2].opcode - VM_ADD + VM_ADDK, .arg = instr.arg });
+            i += 2;
+        } else if (fused_operand && instr.opcode == VM_LOAD) {
+            code_append(&out, (Instruction){ items[i + 2].opcode - VM_ADD + VM_LOADADD, .varname = instr.varname, .slot = instr.slot });
+            i += 2;
+        } else if (instr.opcode == VM_ROT && i + 1 < len && vm_opcode_is_binop(items[i + 1].opcode)
+                && code_swap_operands(&out)) {
+            // The binop itself is appended on the next iteration.
+        } else if (instr.opcode == VM_DUP && i + 1 < len && items[i + 1].opcode == VM_STORE) {
+            code_append(&out, (Instruction){ VM_STOREKEEP, .varname = items[i + 1].varname, .slot = items[i + 1].slot });
+            i += 1;
+        } else {
+            code_append(&out, instr);
+        }
+    }
+
+    vnl_free(code->items);
+    *code = out;
+}
+
+
+
+// Registers are allocated like a stack: every subexpression evaluates into the register
+// it is given, and temporaries above it are free again once the parent has consumed them.
+typedef struct {
+    Vnl_Executor *exec;
+    RegCode *code;
+    Reg next;
+} RegCompiler;
+
+Reg regc_alloc(RegCompiler *rc, size_t count) {
+    Reg first = rc->next;
+    rc->next += count;
+    if (rc->next > rc->code->nregs) {
+        rc->code->nregs = rc->next;
+    }
+    return first;
+}
+
+bool ast_has_assignment(const ASTNode *ast) {
+    switch (ast->_ast_type) {
+        case ASTTYPE_BINOP: {
+            const ASTNode_BinOp *astnode = (void *)ast;
+            return astnode->op == BINOP_SET
+                || ast_has_assignment(astnode->lhs)
+                || ast_has_assignment(astnode->rhs);
+        }
+
+        case ASTTYPE_ARRAY_LITERAL: {
+            const ASTNode_ArrayLiteral *astnode = (void *)ast;
+            for (size_t i = 0; i < astnode->len; ++i) {
+                if (ast_has_assignment(astnode->items[i])) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        case ASTTYPE_INDEX: {
+            const ASTNode_Index *astnode = (void *)ast;
+            return ast_has_assignment(astnode->target) || ast_has_assignment(astnode->index);
+        }
+
+        case ASTTYPE_SLICE: {
+            const ASTNode_Slice *astnode = (void *)ast;
+            const ASTNode *children[] = { astnode->target, astnode->start, astnode->stop, astnode->step };
+            for (size_t i = 0; i < 4; ++i) {
+                if (children[i] && ast_has_assignment(children[i])) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        default:
+            return false;
+    }
+}
+
+ParseError regc_expr(RegCompiler *rc, const ASTNode *ast, Reg dst);
+
+// Literals and variables become direct operands; anything else is evaluated into `scratch`.
+ParseError regc_operand(RegCompiler *rc, const ASTNode *ast, Reg scratch, RegOperand *opnd) {
+    switch (ast->_ast_type) {
+        case ASTTYPE_NUMLIT: {
+            const ASTNode_Numlit *astnode = (void *)ast;
+            *opnd = (RegOperand){ OPND_CONST, .value = vnl_value_from_number(astnode->value) };
+            return PARSEERR_OK;
+        }
+
+        case ASTTYPE_STRLIT: {
+            const ASTNode_Strlit *astnode = (void *)ast;
+            Vnl_StringObject *str = vnl_strobj_new(rc->exec->pool, astnode->value);
+            Vnl_Value val = vnl_value_from_object((Vnl_Object *)str);
+            vnl_value_acquire(val);
+            *opnd = (RegOperand){ OPND_CONST, .value = val };
+            return PARSEERR_OK;
+        }
+
+        case ASTTYPE_IDENT: {
+            const ASTNode_Ident *astnode = (void *)ast;
+            *opnd = (RegOperand){ OPND_VAR, .varname = astnode->value, .slot = vnl_vartable_resolve(rc->exec->vars, astnode->value) };
+            return PARSEERR_OK;
+        }
+
+        case ASTTYPE_CONST: {
+            const ASTNode_Const *astnode = (void *)ast;
+            *opnd = (RegOperand){ OPND_CONST, .value = astnode->value };
+            return PARSEERR_OK;
+        }
+
+        default: {
+            *opnd = (RegOperand){ OPND_REG, .reg = scratch };
+            return regc_expr(rc, ast, scratch);
+        }
+    }
+}
+
+// `dst = lhs op rhs` for the instructions with two operands.
+ParseError regc_binary(RegCompiler *rc, RegOpcode opcode, const ASTNode *lhs, const ASTNode *rhs, Reg dst) {
+    // A variable operand is read when the operation runs, so if the right side
+    // assigns, the left side has to be read into a register first.
+    ParseError err;
+    RegOperand a;
+    if (lhs->_ast_type == ASTTYPE_IDENT && ast_has_assignment(rhs)) {
+        err = regc_expr(rc, lhs, dst);
+        a = (RegOperand){ OPND_REG, .reg = dst };
+    } else {
+        err = regc_operand(rc, lhs, dst, &a);
+    }
+    if (err) {
+        return err;
+    }
+    Reg tmp = regc_alloc(rc, 1);
+    RegOperand b;
+    if ((err = regc_operand(rc, rhs, tmp, &b))) {
+        // Not in the code yet, so the code can't release it.
+        if (a.kind == OPND_CONST) {
+            vnl_value_release(a.value);
+        }
+        return err;
+    }
+    rc->next = tmp;
+
+    RegInstruction instr = { opcode, .dst = dst, .a = a, .b = b };
+    regcode_append(rc->code, instr);
+    return PARSEERR_OK;
+}
+
+// Appends the code for `ast`. On errors the code is left unfinished, and the caller frees it.
+ParseError regc_expr(RegCompiler *rc, const ASTNode *ast, Reg dst) {
+    ParseError err = PARSEERR_OK;
+    switch (ast->_ast_type) {
+        case ASTTYPE_NUMLIT:
+        case ASTTYPE_STRLIT:
+        case ASTTYPE_IDENT:
+        case ASTTYPE_CONST: {
+            RegInstruction instr = { RVM_MOVE, .dst = dst };
+            regc_operand(rc, ast, dst, &instr.a);
+            regcode_append(rc->code, instr);
+        } break;
+
+        case ASTTYPE_BINOP: {
+            const ASTNode_BinOp *astnode = (void *)ast;
+            if (astnode->op == BINOP_SET) {
+                if (astnode->lhs->_ast_type != ASTTYPE_IDENT) {
+                    return PARSEERR_AST_NOT_ASSIGNABLE;
+                }
+                const ASTNode_Ident *ident = (void *)astnode->lhs;
+                if ((err = regc_expr(rc, astnode->rhs, dst))) {
+                    return err;
+                }
+                RegInstruction instr = {
+                    RVM_STORE,
+                    .a = { OPND_REG, .reg = dst },
+                    .varname = ident->value,
+                    .slot = vnl_vartable_resolve(rc->exec->vars, ident->value),
+                };
+                regcode_append(rc->code, instr);
+                break;
+            }
+
+            err = regc_binary(rc, (RegOpcode)(astnode->op - BINOP_ADD + RVM_ADD), astnode->lhs, astnode->rhs, dst);
+        } break;
+
+        case ASTTYPE_INDEX: {
+            const ASTNode_Index *astnode = (void *)ast;
+            err = regc_binary(rc, RVM_INDEX, astnode->target, astnode->index, dst);
+        } break;
+
+        case ASTTYPE_SLICE: {
+            const ASTNode_Slice *astnode = (void *)ast;
+            const ASTNode *bounds[] = { astnode->start, astnode->stop, astnode->step };
+            unsigned parts = ast_slice_parts(astnode);
+            Reg base = regc_alloc(rc, 1 + slice_parts_count(parts));
+            if ((err = regc_expr(rc, astnode->target, base))) {
+                return err;
+            }
+            Reg next = base + 1;
+            for (size_t i = 0; i < 3; ++i) {
+                if (bounds[i] && (err = regc_expr(rc, bounds[i], next++))) {
+                    return err;
+                }
+            }
+            rc->next = base;
+            RegInstruction instr = { RVM_SLICE, .dst = dst, .a = { OPND_REG, .reg = base }, .slice_parts = parts };
+            regcode_append(rc->code, instr);
+        } break;
+
+        case ASTTYPE_CALL: {
+            return PARSEERR_AST_UNSUPPORTED_CALL;
+        } break;
+
+        case ASTTYPE_ARRAY_LITERAL: {
+            const ASTNode_ArrayLiteral *astnode = (void *)ast;
+            Reg base = regc_alloc(rc, astnode->len);
+            for (size_t i = 0; i < astnode->len; ++i) {
+                if ((err = regc_expr(rc, astnode->items[i], base + i))) {
+                    return err;
+                }
+            }
+            rc->next = base;
+            RegInstruction instr = { RVM_MAKEARR, .dst = dst, .a = { OPND_REG, .reg = base }, .makearr_len = astnode->len };
+            regcode_append(rc->code, instr);
+        } break;
+    }
+    return err;
+}
+
+ParseError exec_compile_regs(Vnl_Executor *exec, const ASTNode *ast, RegCode *code) {
+    RegCompiler rc = { exec, code, 0 };
+    Reg result = regc_alloc(&rc, 1);
+    ParseError err = regc_expr(&rc, ast, result);
+    if (err) {
+        return err;
+    }
+    RegInstruction instr = { RVM_RET, .a = { OPND_REG, .reg = result } };
+    regcode_append(code, instr);
+    return PARSEERR_OK;
 }
 
 
@@ -1300,7 +3931,7 @@ void exec_compile_ast(Vnl_Executor *exec, const ASTNode *ast, Code *compile_resu
 void exec_stack_print(const Vnl_Executor *exec) {
     printf("Stack{ ");
     for (size_t i = 0; i < exec->stack.len; ++i) {
-        object_print(exec->stack.stack[i]);
+        value_print(exec->stack.stack[i]);
         if (i < exec->stack.len - 1)
             printf(", ");
     }
@@ -1308,24 +3939,64 @@ void exec_stack_print(const Vnl_Executor *exec) {
 }
 
 
-void exec_print_var(Vnl_String varname, const Vnl_Object *value) {
+void exec_print_var(Vnl_String varname, Vnl_Value value) {
 	vnl_string_print_escaped(varname);
 	printf(" -> ");
-	object_print(value);
+	value_print(value);
 	printf("\n");
 }
 
 void exec_print_vars(const Vnl_Executor *exec) {
     printf("Vars{\n");
-    vnl_strmap_foreach(exec->varlist, exec_print_var);
+    vnl_vartable_foreach(exec->vars, exec_print_var);
     printf(" }\n");
 }
 
 
+void exec_print_pool_stats(const Vnl_Executor *exec) {
+    Vnl_ObjectPoolStats stats = vnl_objpool_stats(exec->pool);
+    printf(
+        "Pool{ live=%zu, deferred=%zu, slabs=%zu, slots=%zu, reserved=%zuB, utilisation=%.1f%% }\n",
+        stats.live_objects,
+        stats.deferred_objects,
+        stats.slabs,
+        stats.slots_total,
+        stats.bytes_reserved,
+        stats.utilisation * 100.0
+    );
+}
+
+
+void exec_print_heap_stats(const Vnl_Executor *exec) {
+    printf(
+        "Heap{ live=%zuB, peak=%zuB, allocs=%zu, frees=%zu, strings=%zu, arrays=%zu, limit=%zuB }\n",
+        exec->heap.live_bytes,
+        exec->heap.peak_bytes,
+        exec->heap.allocations,
+        exec->heap.frees,
+        exec->heap.objects_by_type[VNL_OBJTYPE_STRING],
+        exec->heap.objects_by_type[VNL_OBJTYPE_ARRAY] + exec->heap.objects_by_type[VNL_OBJTYPE_F64ARRAY]
+            + exec->heap.objects_by_type[VNL_OBJTYPE_ARRAYVIEW],
+        exec->heap.limit
+    );
+}
+
+
+void exec_print_cache_stats(const Vnl_Executor *exec) {
+    printf(
+        "CompileCache{ entries=%zu/%d, hits=%zu, misses=%zu }\n",
+        exec->cache->len,
+        COMPILE_CACHE_CAPACITY,
+        exec->cache->hits,
+        exec->cache->misses
+    );
+}
+
+
 void exec_stack_free(Vnl_Executor *exec) {
     for (size_t i = 0; i < exec->stack.len; ++i) {
-        vnl_object_release(exec->stack.stack[i]);
-        exec->stack.stack[i] = nullptr;
+        vnl_value_release(exec->stack.stack[i]);
+        exec->stack.stack[i] = VNL_NULL;
     }
     exec->stack.len = 0;
 }
@@ -1335,78 +4006,160 @@ Vnl_String cstr2str(Vnl_CString s) {
     return (Vnl_String){ s, strlen(s) };
 }
 
-double obj_to_number(Vnl_Object *obj) {
-    if (!obj && !obj_is_number(obj)) {
-        return nan(0);
+double val_to_number(Vnl_Value val) {
+    if (!val_is_number(val)) {
+        return nan("");
     }
-    Vnl_NumberObject *num = (void *)obj;
-    return num->value;
+    return vnl_value_as_number(val);
 }
 
-double obj_to_number_or(Vnl_Object *obj, double d) {
-    if (!obj && !obj_is_number(obj)) {
+double val_to_number_or(Vnl_Value val, double d) {
+    if (!val_is_number(val)) {
         return d;
     }
-    Vnl_NumberObject *num = (void *)obj;
-    return num->value;
+    return vnl_value_as_number(val);
 }
 
 
-Vnl_Object *exec_getvar_cstr(Vnl_Executor *exec, Vnl_CString varname) {
+Vnl_Value exec_getvar_cstr(Vnl_Executor *exec, Vnl_CString varname) {
     return vnl_exec_getvar(exec, cstr2str(varname));
 }
 
 
 
 
+// The executor struct itself is not charged to its own heap - everything it owns is.
 Vnl_Executor *vnl_exec_new() {
 	Vnl_Executor *exec = vnl_malloc(sizeof(*exec));
-	exec->varlist = vnl_strmap_new();
-	exec->error = nullptr;
-	exec->stack = (Vnl_Stack){};
+	exec->heap = (Vnl_Heap){};
+	Vnl_Heap *prev = vnl_heap_enter(&exec->heap);
+	exec->vars = vnl_vartable_new();
+	exec->pool = vnl_objpool_new();
+	exec->free_budget = 0;
+	exec->error = VNL_NULL;
+	if (!exec_stack_init(&exec->stack)) {
+		printf(VNL_ANSICOL_RED "Fatal error: unable to reserve the VM stack!" VNL_ANSICOL_RESET);
+		abort();
+	}
+	exec->arena = (Vnl_Arena){};
+	exec->cache = vnl_malloc(sizeof(*exec->cache));
+	exec->regs = nullptr;
+	exec->regs_cap = 0;
+	exec->jit = false;
+	exec->jit_verify = false;
+	exec->simd = VNL_ISA_AVX512;
+	exec->threads = 0;
+	exec->parallel_threshold = PARALLEL_THRESHOLD;
+	vnl_heap_leave(prev);
 	return exec;
 }
 
 void vnl_exec_free(Vnl_Executor *self) {
+	vnl_objpool_set_incremental(self->pool, false);
 	exec_stack_free(self);
-	vnl_object_release(self->error);
-	vnl_strmap_free(self->varlist);
+	exec_stack_unmap(&self->stack);
+	exec_cache_free(self->cache);
+	vnl_free(self->regs);
+	vnl_arena_free(&self->arena);
+	vnl_value_release(self->error);
+	vnl_vartable_free(self->vars);
+	vnl_object_collect(self->pool, SIZE_MAX);
+	vnl_objpool_free(self->pool);
 	vnl_free(self);
 }
 
-void vnl_exec_setvar(Vnl_Executor *self, Vnl_String name, Vnl_Object *obj) {
-	vnl_strmap_insert(self->varlist, name, obj);
+void vnl_exec_setvar(Vnl_Executor *self, Vnl_String name, Vnl_Value val) {
+	Vnl_Heap *prev = vnl_heap_enter(&self->heap);
+	vnl_vartable_set(self->vars, vnl_vartable_resolve(self->vars, vnl_intern_s(name)), val);
+	vnl_heap_leave(prev);
 }
 
-Vnl_Object *vnl_exec_getvar(Vnl_Executor *self, Vnl_String name) {
-	return vnl_strmap_find(self->varlist, name);
+Vnl_Value vnl_exec_getvar(Vnl_Executor *self, Vnl_String name) {
+	const Vnl_Symbol *sym = vnl_intern_find_s(name);
+	if (sym == nullptr) {
+		return VNL_NULL;
+	}
+	size_t slot = vnl_vartable_lookup(self->vars, sym);
+	if (slot == VNL_VARTABLE_NOSLOT) {
+		return VNL_NULL;
+	}
+	return vnl_vartable_get(self->vars, slot);
 }
 
-void vnl_exec_delvar(Vnl_Executor *self, Vnl_String name) {
-	vnl_object_release(vnl_strmap_pop(self->varlist, name));
+Vnl_ObjectPoolStats vnl_exec_pool_stats(const Vnl_Executor *self) {
+	return vnl_objpool_stats(self->pool);
 }
 
-bool vnl_exec_string(Vnl_Executor *exec, Vnl_String source) {
- 	Tokens tokens = {};
+Vnl_Heap vnl_exec_heap_stats(const Vnl_Executor *self) {
+	return self->heap;
+}
 
-    bool debug = obj_to_number_or(exec_getvar_cstr(exec, "__debug__"), 1);
-    bool debug_print_tokens = obj_to_number_or(exec_getvar_cstr(exec, "__debug_tokens__"), (double)debug);
-    bool debug_print_ast = obj_to_number_or(exec_getvar_cstr(exec, "__debug_ast__"), (double)debug);
-    bool debug_print_code = obj_to_number_or(exec_getvar_cstr(exec, "__debug_code__"), (double)debug);
-    bool debug_print_stack = obj_to_number_or(exec_getvar_cstr(exec, "__debug_stack__"), (double)debug);
-    bool debug_print_vars = obj_to_number_or(exec_getvar_cstr(exec, "__debug_vars__"), (double)debug);
+// Zero disables the limit. Checked between instructions, so a single allocation may
+// overshoot it before the running statement fails.
+void vnl_exec_set_memory_limit(Vnl_Executor *self, size_t limit) {
+	self->heap.limit = limit;
+	self->heap.exceeded = limit && self->heap.live_bytes > limit;
+}
 
-    ParseError err = tokenize(&source, &tokens);
-    if (err) {
-        print_parseerr(err, source, nullptr, nullptr);
-        tokens_free(&tokens);
-        return true;
-    }
+Vnl_CompileCacheStats vnl_exec_cache_stats(const Vnl_Executor *self) {
+	return (Vnl_CompileCacheStats){
+		.entries = self->cache->len,
+		.capacity = COMPILE_CACHE_CAPACITY,
+		.hits = self->cache->hits,
+		.misses = self->cache->misses,
+	};
+}
 
+void vnl_exec_delvar(Vnl_Executor *self, Vnl_String name) {
+	const Vnl_Symbol *sym = vnl_intern_find_s(name);
+	if (sym == nullptr) {
+		return;
+	}
+	size_t slot = vnl_vartable_lookup(self->vars, sym);
+	if (slot == VNL_VARTABLE_NOSLOT) {
+		return;
+	}
+	vnl_value_release(vnl_vartable_pop(self->vars, slot));
+}
 
+// Runs the front end over a single statement. Tokens and the AST live in the executor's
+// arena, which is reset before returning; only the compiled code outlives the call.
+typedef enum {
+    COMPILE_REGVM = 1 << 0,
+    COMPILE_OPTIMIZE = 1 << 1,
+} CompileOption;
+
+// Compile options come from the executor's variables at the time a statement is compiled.
+unsigned exec_compile_options(Vnl_Executor *exec) {
+    unsigned options = 0;
+    if (val_to_number_or(exec_getvar_cstr(exec, "__regvm__"), 0)) {
+        options |= COMPILE_REGVM;
+    }
+    if (val_to_number_or(exec_getvar_cstr(exec, "__optimize__"), 1)) {
+        options |= COMPILE_OPTIMIZE;
+    }
+    return options;
+}
 
+// Tokenizes, parses and (with COMPILE_OPTIMIZE) folds one statement. The AST lives in the
+// executor's arena, which the caller resets once done with it; on errors it is reset here.
+ParseError exec_parse_source(
+    Vnl_Executor *exec,
+    Vnl_String source,
+    unsigned options,
+    bool print_tokens,
+    bool print_ast,
+    ASTNode **out
+) {
+    Tokens tokens = {};
+    ParseError err = tokenize(&exec->arena, &source, &tokens);
+    if (err) {
+        print_parseerr(err, source, nullptr);
+        vnl_arena_reset(&exec->arena);
+        return err;
+    }
 
-    if (debug_print_tokens) {
+    if (print_tokens) {
         for (size_t i = 0; i < tokens.len; ++i) {
             const Vnl_Token *tok = &tokens.items[i];
             token_display(tok);
@@ -1414,36 +4167,793 @@ bool vnl_exec_string(Vnl_Executor *exec, Vnl_String source) {
         }
     }
 
-
-    TokenIterator titer = { &tokens, 0 };
+    TokenIterator titer = { &tokens, 0, &exec->arena };
     ASTNode *ast = nullptr;
     err = parse_statement(&titer, &ast);
     if (err) {
-        print_parseerr(err, source, ast, &titer);
+        print_parseerr(err, source, &titer);
+        vnl_arena_reset(&exec->arena);
+        return err;
+    }
+
+    if (print_ast) ast_println(ast);
+
+    if (options & COMPILE_OPTIMIZE) {
+        ast = ast_fold(exec, ast);
+        if (print_ast) {
+            printf("; after folding:\n");
+            ast_println(ast);
+        }
+    }
+
+    *out = ast;
+    return PARSEERR_OK;
+}
+
+ParseError exec_compile_source(
+    Vnl_Executor *exec,
+    Vnl_String source,
+    unsigned options,
+    bool print_tokens,
+    bool print_ast,
+    bool print_code,
+    Vnl_Program *program
+) {
+    ASTNode *ast = nullptr;
+    ParseError err = exec_parse_source(exec, source, options, print_tokens, print_ast, &ast);
+    if (err) {
+        return err;
+    }
+
+    *program = (Vnl_Program){ .regvm = options & COMPILE_REGVM };
+    if (program->regvm) {
+        err = exec_compile_regs(exec, ast, &program->regcode);
+        if (err) {
+            regcode_free(&program->regcode);
+        }
     } else {
-        if (debug_print_ast) ast_println(ast);
+        Code ir = {};
+        err = exec_compile_ast(exec, ast, &ir);
+        if (err) {
+            code_free(&ir);
+        } else {
+            if (options & COMPILE_OPTIMIZE) {
+                if (print_code) {
+                    printf("; before peephole:\n");
+                    code_print(&ir);
+                    printf("; after peephole:\n");
+                }
+                code_optimize(&ir);
+            }
+            code_assemble(&ir, &program->code);
+        }
+    }
+    vnl_arena_reset(&exec->arena);
+    if (err) {
+        print_parseerr(err, source, nullptr);
+    }
+    return err;
+}
+
+#define JIT_HOT_RUNS 8
+#define JIT_MAX_RESULTS 4
+
+// Lowers bytecode to the JIT's op list. Only arithmetic over numeric constants and
+// variables is supported; anything else keeps the program in the interpreter. The
+// superinstructions are split back into their parts, with the ROT they replaced.
+Vnl_JitCode *bc_jit_compile(const Bytecode *code) {
+    Vnl_JitOp *ops = vnl_malloc(sizeof(*ops) * (code->ninstrs * 3 + 1));
+    size_t len = 0;
+    const uint8_t *pc = code->bytes;
+    while (pc < code->bytes + code->len) {
+        Instruction instr = bc_decode(code, &pc);
+        VMOpcode opcode = vm_opcode_generic(instr.opcode);
+        if (vm_operand_kind(opcode) == OPERAND_CONST && !val_is_number(instr.arg)) {
+            vnl_free(ops);
+            return nullptr;
+        }
+        switch (opcode) {
+            case VM_PUT:
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_CONST, .num = vnl_value_as_number(instr.arg) };
+                break;
+            case VM_LOAD:
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_LOAD, .slot = instr.slot };
+                break;
+            case VM_STOREKEEP:
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_DUP };
+                [[fallthrough]];
+            case VM_STORE:
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_STORE, .slot = instr.slot };
+                break;
+            case VM_DUP:
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_DUP };
+                break;
+            case VM_ROT:
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_SWAP };
+                break;
+            case VM_ADD: case VM_SUB: case VM_MUL: case VM_DIV: case VM_MOD:
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_ADD + (opcode - VM_ADD) };
+                break;
+            case VM_ADDK: case VM_SUBK: case VM_MULK: case VM_DIVK: case VM_MODK:
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_CONST, .num = vnl_value_as_number(instr.arg) };
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_SWAP };
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_ADD + (opcode - VM_ADDK) };
+                break;
+            case VM_LOADADD: case VM_LOADSUB: case VM_LOADMUL: case VM_LOADDIV: case VM_LOADMOD:
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_LOAD, .slot = instr.slot };
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_SWAP };
+                ops[len++] = (Vnl_JitOp){ VNL_JITOP_ADD + (opcode - VM_LOADADD) };
+                break;
+            default:
+                vnl_free(ops);
+                return nullptr;
+        }
+    }
+
+    Vnl_JitCode *jit = vnl_jit_compile(ops, len);
+    vnl_free(ops);
+    if (jit && vnl_jit_result_count(jit) > JIT_MAX_RESULTS) {
+        vnl_jit_free(jit);
+        jit = nullptr;
+    }
+    return jit;
+}
+
+// Whether the JIT and the interpreter agree on a value: bit for bit, except that all NaNs
+// are alike. Which NaN operand an operation passes on is up to the C compiler, so the
+// interpreter doesn't pick a consistent one either.
+bool jit_results_agree(Vnl_Value a, Vnl_Value b) {
+    if (vnl_value_is_same(a, b)) {
+        return true;
+    }
+    return vnl_value_is_number(a) && vnl_value_is_number(b)
+        && isnan(vnl_value_as_number(a)) && isnan(vnl_value_as_number(b));
+}
 
-        Code code = {0};
-        exec_compile_ast(exec, ast, &code);
+// Runs the JIT code and the interpreter from the same variables and checks that they
+// leave the same values on the stack and in the variables. The guards
+// mean none of the variables involved holds an object, so they can be saved and
+// restored by copying. The interpreter's outcome is the one kept.
+ExecError exec_jit_verify(Vnl_Executor *exec, Vnl_Program *program) {
+    const Bytecode *code = &program->code;
+    Vnl_Value *values = exec->vars->values;
+    Vnl_Value results[JIT_MAX_RESULTS];
+    Vnl_Value *before = vnl_malloc(sizeof(*before) * (code->nnames ? code->nnames : 1));
+    Vnl_Value *after = vnl_malloc(sizeof(*after) * (code->nnames ? code->nnames : 1));
+    for (size_t i = 0; i < code->nnames; ++i) {
+        before[i] = values[code->slots[i]];
+    }
+
+    if (!vnl_jit_run(program->jit, values, results)) {
+        vnl_free(before);
+        vnl_free(after);
+        return exec_code(exec, &program->code);
+    }
+    for (size_t i = 0; i < code->nnames; ++i) {
+        after[i] = values[code->slots[i]];
+        values[code->slots[i]] = before[i];
+    }
+
+    size_t base = exec->stack.len;
+    size_t nresults = vnl_jit_result_count(program->jit);
+    ExecError err = exec_code(exec, &program->code);
+    bool same = !err && exec->stack.len - base == nresults;
+    for (size_t i = 0; same && i < nresults; ++i) {
+        same = jit_results_agree(exec->stack.stack[base + i], results[i]);
+    }
+    for (size_t i = 0; same && i < code->nnames; ++i) {
+        same = jit_results_agree(exec->vars->values[code->slots[i]], after[i]);
+    }
+    if (!err && !same) {
+        printf(VNL_ANSICOL_RED "Error: JIT and interpreter results differ!\n" VNL_ANSICOL_RESET);
+        err = EXEC_ERR;
+    }
 
-        if (debug_print_code) code_print(&code);
+    vnl_free(before);
+    vnl_free(after);
+    return err;
+}
 
-        if (exec_code(exec, &code)) {
-            printf(VNL_ANSICOL_RED"<Error>\n"VNL_ANSICOL_RESET);
+// Returns false if the program has to be interpreted instead: it isn't hot yet, can't
+// be compiled, or a type guard failed. A failed guard has no side effects.
+bool exec_run_jit(Vnl_Executor *exec, Vnl_Program *program, ExecError *err) {
+    if (program->jit == nullptr) {
+        if (program->nojit || ++program->runs < JIT_HOT_RUNS) {
+            return false;
         }
+        program->jit = bc_jit_compile(&program->code);
+        if (program->jit == nullptr) {
+            program->nojit = true;
+            return false;
+        }
+    }
 
-        if (debug_print_stack) exec_stack_print(exec);
-        if (debug_print_vars) exec_print_vars(exec);
+    if (exec->jit_verify) {
+        *err = exec_jit_verify(exec, program);
+        return true;
+    }
 
-        if (exec->stack.len) {
-            object_print(exec->stack.stack[exec->stack.len-1]);
-            printf("\n");
+    Vnl_Value results[JIT_MAX_RESULTS];
+    if (!exec_stack_reserve(exec, vnl_jit_result_count(program->jit))) {
+        *err = EXEC_ERR;
+        return true;
+    }
+    if (!vnl_jit_run(program->jit, exec->vars->values, results)) {
+        return false;
+    }
+    for (size_t i = 0; i < vnl_jit_result_count(program->jit); ++i) {
+        exec_stack_give(exec, results[i]);
+    }
+    *err = EXEC_OK;
+    return true;
+}
+
+// Forces the stack values from `from` up, dropping any that fail to evaluate.
+ExecError exec_force_stack(Vnl_Executor *exec, size_t from) {
+    ExecError err = EXEC_OK;
+    size_t kept = from;
+    for (size_t i = from; i < exec->stack.len; ++i) {
+        Vnl_Value val = exec->stack.stack[i];
+        exec->stack.stack[i] = VNL_NULL;
+        if (exec_force(exec, &val)) {
+            vnl_value_release(val);
+            err = EXEC_ERR;
+        } else {
+            exec->stack.stack[kept++] = val;
+        }
+    }
+    exec->stack.len = kept;
+    return err;
+}
+
+ExecError exec_run_program(Vnl_Executor *exec, Vnl_Program *program) {
+    // Only allocations made while running can trip the limit, so a script that is
+    // already over it can still free memory by reassigning.
+    exec->heap.exceeded = false;
+    ExecError err;
+    if (program->regvm) {
+        err = exec_regcode(exec, &program->regcode);
+    } else if (exec->jit && !exec->free_budget && exec_run_jit(exec, program, &err)) {
+        // JIT code never allocates, but it also doesn't pay off incremental destruction
+        // debt, so it stays out of the way while that is on.
+    } else {
+        err = exec_code(exec, &program->code);
+    }
+    // What is left on the stack gets printed, so it can't stay lazy. That is normally
+    // just the value of the statement, but a failed one can leave lazy operands anywhere.
+    if (exec->stack.len && exec_force_stack(exec, err ? 0 : exec->stack.len - 1)) {
+        err = EXEC_ERR;
+    }
+    return err;
+}
+
+void program_print(const Vnl_Program *program) {
+    if (program->regvm) {
+        regcode_print(&program->regcode);
+    } else {
+        bytecode_print(&program->code);
+        if (program->jit) {
+            printf("; jit: %zu bytes of machine code\n", vnl_jit_code_size(program->jit));
         }
+    }
+}
 
+
+// Re-runs already executed code `runs` times and reports the mean dispatch cost.
+// Each run sees the variables left by the previous one, like typing the statement again.
+void exec_bench(Vnl_Executor *exec, Vnl_Program *program, size_t runs) {
+    struct timespec start, stop;
+    size_t executed = 0;
+    size_t len = program->regvm ? program->regcode.len : program->code.ninstrs;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < runs; ++i) {
         exec_stack_free(exec);
-        ast_free(ast);
+        if (exec_run_program(exec, program)) {
+            break;
+        }
+        executed += len;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    double ns = (stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec);
+    printf(
+        "Bench{ runs=%zu, instructions=%zu, total=%.3fms, per_instruction=%.2fns }\n",
+        runs,
+        executed,
+        ns / 1e6,
+        executed ? ns / executed : 0.0
+    );
+}
+
+
+bool exec_string(Vnl_Executor *exec, Vnl_String source) {
+    bool debug = val_to_number_or(exec_getvar_cstr(exec, "__debug__"), 1);
+    bool debug_print_tokens = val_to_number_or(exec_getvar_cstr(exec, "__debug_tokens__"), (double)debug);
+    bool debug_print_ast = val_to_number_or(exec_getvar_cstr(exec, "__debug_ast__"), (double)debug);
+    bool debug_print_code = val_to_number_or(exec_getvar_cstr(exec, "__debug_code__"), (double)debug);
+    bool debug_print_stack = val_to_number_or(exec_getvar_cstr(exec, "__debug_stack__"), (double)debug);
+    bool debug_print_vars = val_to_number_or(exec_getvar_cstr(exec, "__debug_vars__"), (double)debug);
+    bool debug_print_pool = val_to_number_or(exec_getvar_cstr(exec, "__debug_pool__"), (double)debug);
+    bool debug_print_heap = val_to_number_or(exec_getvar_cstr(exec, "__debug_heap__"), (double)debug);
+    bool debug_print_cache = val_to_number_or(exec_getvar_cstr(exec, "__debug_cache__"), (double)debug);
+
+    Vnl_Value memory_limit = exec_getvar_cstr(exec, "__memory_limit__");
+    if (val_is_number(memory_limit) && vnl_value_as_number(memory_limit) >= 0) {
+        vnl_exec_set_memory_limit(exec, vnl_value_as_number(memory_limit));
+    }
+
+    // A non-zero budget switches to incremental destruction: dead objects are queued and
+    // torn down at most `__free_budget__` units of work per executed instruction.
+    exec->free_budget = val_to_number_or(exec_getvar_cstr(exec, "__free_budget__"), 0);
+    vnl_objpool_set_incremental(exec->pool, exec->free_budget > 0);
+
+    // The JIT is off by default. `__jit_verify__` also runs the interpreter on every
+    // JIT-compiled statement and reports any difference between the two.
+    exec->jit = val_to_number_or(exec_getvar_cstr(exec, "__jit__"), 0);
+    exec->jit_verify = val_to_number_or(exec_getvar_cstr(exec, "__jit_verify__"), 0);
+
+    // Array arithmetic uses the widest vector instructions the CPU has. `__simd__` caps
+    // them for this executor: 0 is plain scalar code, then SSE2, AVX2 and AVX-512.
+    // Anything not below AVX-512, NaN included, leaves them uncapped.
+    double simd = val_to_number_or(exec_getvar_cstr(exec, "__simd__"), VNL_ISA_AVX512);
+    exec->simd = simd < VNL_ISA_AVX512 ? (simd > VNL_ISA_SCALAR ? (Vnl_KernelIsa)simd : VNL_ISA_SCALAR) : VNL_ISA_AVX512;
+
+    // Large array operations run on `__threads__` threads, one per CPU unless set. Both
+    // settings belong to this executor, even though the worker threads are shared.
+    double threads = val_to_number_or(exec_getvar_cstr(exec, "__threads__"), 0);
+    exec->threads = 0;
+    if (threads >= 1) {
+        size_t max_threads = vnl_threadpool_max_threads();
+        exec->threads = threads < max_threads ? threads : max_threads;
+    }
+    double threshold = val_to_number_or(exec_getvar_cstr(exec, "__parallel_threshold__"), PARALLEL_THRESHOLD);
+    exec->parallel_threshold = threshold >= 0 ? threshold : PARALLEL_THRESHOLD;
+
+    // Token and AST dumps need the front end to run, so they bypass the cache.
+    bool use_cache = !debug_print_tokens && !debug_print_ast;
+    unsigned options = exec_compile_options(exec);
+    uint64_t hash = XXH64(source.chars, source.len, COMPILE_CACHE_SEED);
+    Vnl_Program fresh = {};
+    Vnl_Program *program = use_cache ? exec_cache_find(exec->cache, source, hash, options) : nullptr;
+
+    if (program == nullptr) {
+        if (exec_compile_source(exec, source, options, debug_print_tokens, debug_print_ast, debug_print_code, &fresh)) {
+            return true;
+        }
+        program = use_cache ? exec_cache_insert(exec->cache, source, hash, options, fresh) : &fresh;
+    }
+
+    if (debug_print_code) program_print(program);
+
+    ExecError err = exec_run_program(exec, program);
+    if (err) {
+        printf(VNL_ANSICOL_RED"<Error>\n"VNL_ANSICOL_RESET);
+    }
+
+    size_t bench_runs = val_to_number_or(exec_getvar_cstr(exec, "__bench__"), 0);
+    if (bench_runs && !err) {
+        exec_bench(exec, program, bench_runs);
+    }
+
+    if (debug_print_stack) exec_stack_print(exec);
+    if (debug_print_vars) exec_print_vars(exec);
+    if (debug_print_pool) exec_print_pool_stats(exec);
+    if (debug_print_heap) exec_print_heap_stats(exec);
+    if (debug_print_cache) exec_print_cache_stats(exec);
+
+    if (exec->stack.len) {
+        value_print(exec->stack.stack[exec->stack.len-1]);
+        printf("\n");
+    }
+
+    exec_stack_free(exec);
+    if (program == &fresh) {
+        program_free(&fresh);
+    }
+    return err != EXEC_OK;
+}
+
+bool vnl_exec_string(Vnl_Executor *exec, Vnl_String source) {
+    Vnl_Heap *prev = vnl_heap_enter(&exec->heap);
+    bool result = exec_string(exec, source);
+    vnl_heap_leave(prev);
+    return result;
+}
+
+
+Vnl_Program *vnl_exec_compile(Vnl_Executor *exec, Vnl_String source) {
+    Vnl_Heap *prev = vnl_heap_enter(&exec->heap);
+    Vnl_Program *program = vnl_malloc(sizeof(*program));
+    if (exec_compile_source(exec, source, exec_compile_options(exec), false, false, false, program)) {
+        vnl_free(program);
+        program = nullptr;
+    }
+    vnl_heap_leave(prev);
+    return program;
+}
+
+bool vnl_exec_run(Vnl_Executor *exec, Vnl_Program *program, Vnl_Value *result) {
+    Vnl_Heap *prev = vnl_heap_enter(&exec->heap);
+    ExecError err = exec_run_program(exec, program);
+    if (result) {
+        *result = err || !exec->stack.len ? VNL_NULL : exec_stack_pop(exec);
+    }
+    exec_stack_free(exec);
+    vnl_heap_leave(prev);
+    return err != EXEC_OK;
+}
+
+void vnl_program_free(Vnl_Program *program) {
+    if (program == nullptr) {
+        return;
     }
+    program_free(program);
+    vnl_free(program);
+}
+
+
+
+// Runtime for programs compiled ahead of time by vnl_exec_emit_c. Like VM stack slots,
+// every value passed to or returned from these holds one reference.
+size_t vnl_aot_resolve(Vnl_Executor *exec, Vnl_CString name) {
+    return vnl_vartable_resolve(exec->vars, vnl_intern_c(name));
+}
+
+Vnl_Value vnl_aot_string(Vnl_Executor *exec, const char *chars, size_t len) {
+    Vnl_Value val = vnl_value_from_object((Vnl_Object *)vnl_strobj_new(exec->pool, (Vnl_String){ chars, len }));
+    vnl_value_acquire(val);
+    return val;
+}
+
+// Consumes the items.
+Vnl_Value vnl_aot_array(Vnl_Executor *exec, const Vnl_Value *items, size_t len) {
+    return exec_make_array(exec, items, len);
+}
 
-    tokens_free(&tokens);
+bool vnl_aot_load(Vnl_Executor *exec, size_t slot, Vnl_Value *out) {
+    Vnl_Value val = vnl_vartable_get(exec->vars, slot);
+    if (vnl_value_is_null(val)) {
+        error_unknown_variable(exec->vars->names[slot]);
+        return true;
+    }
+    vnl_value_acquire(val);
+    *out = val;
     return false;
 }
+
+void vnl_aot_store(Vnl_Executor *exec, size_t slot, Vnl_Value val) {
+    vnl_vartable_set(exec->vars, slot, val);
+    vnl_value_release(val);
+}
+
+// The slow path of arithmetic; numbers are handled inline by the generated code.
+bool vnl_aot_binop(Vnl_Executor *exec, char op, Vnl_Value a, Vnl_Value b, Vnl_Value *out) {
+    OpKind kind;
+    switch (op) {
+        case '+': kind = BINOP_ADD; break;
+        case '-': kind = BINOP_SUB; break;
+        case '*': kind = BINOP_MUL; break;
+        case '/': kind = BINOP_DIV; break;
+        default:  kind = BINOP_MOD; break;
+    }
+    return exec_binop(exec, kind, a, b, VNL_VARTABLE_NOSLOT, out) != EXEC_OK;
+}
+
+bool vnl_aot_index(Vnl_Executor *exec, Vnl_Value target, Vnl_Value index, Vnl_Value *out) {
+    return exec_index(exec, target, index, out) != EXEC_OK;
+}
+
+bool vnl_aot_slice(Vnl_Executor *exec, Vnl_Value *values, unsigned parts, Vnl_Value *out) {
+    return exec_slice(exec, values, parts, out) != EXEC_OK;
+}
+
+// Evaluates the lazy array operations among `len` values, which is done before they are
+// stored, printed or put into an array.
+bool vnl_aot_force(Vnl_Executor *exec, Vnl_Value *values, size_t len) {
+    return exec_force_all(exec, values, len) != EXEC_OK;
+}
+
+// Releases the first `len` values. Always returns true, so error paths can end in
+// `return vnl_aot_drop(...)`.
+bool vnl_aot_drop(Vnl_Value *values, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        vnl_value_release(values[i]);
+    }
+    return true;
+}
+
+// Runs one compiled statement and reports its outcome the way the REPL does.
+bool vnl_aot_statement(Vnl_Executor *exec, Vnl_AotStatement statement) {
+    Vnl_Heap *prev = vnl_heap_enter(&exec->heap);
+    exec->heap.exceeded = false;
+    Vnl_Value result = VNL_NULL;
+    bool err = statement(exec, &result) || vnl_aot_force(exec, &result, 1);
+    if (err) {
+        vnl_value_release(result);
+        printf(VNL_ANSICOL_RED"<Error>\n"VNL_ANSICOL_RESET);
+    } else if (!vnl_value_is_null(result)) {
+        value_print(result);
+        printf("\n");
+        vnl_value_release(result);
+    }
+    vnl_heap_leave(prev);
+    return err;
+}
+
+
+void emit_c_string(FILE *out, Vnl_String str) {
+    fputc('"', out);
+    for (size_t i = 0; i < str.len; ++i) {
+        unsigned char c = str.chars[i];
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c >= 0x20 && c < 0x7f) {
+            fputc(c, out);
+        } else {
+            fprintf(out, "\\%03o", c);
+        }
+    }
+    fputc('"', out);
+}
+
+// Numbers are written as their exact bit pattern, so constants round-trip bit for bit.
+void emit_c_value(FILE *out, Vnl_Value val) {
+    if (vnl_value_is_number(val)) {
+        fprintf(out, "((Vnl_Value){ UINT64_C(0x%016" PRIx64 ") })", val.bits);
+    } else if (val_is_string(val)) {
+        Vnl_String str = vnl_strobj_flatten((Vnl_StringObject *)vnl_value_as_object(val));
+        fprintf(out, "vnl_aot_string(exec, ");
+        emit_c_string(out, str);
+        fprintf(out, ", %zu)", str.len);
+    } else if (vnl_value_as_object(val)->type == VNL_OBJTYPE_F64ARRAY) {
+        const Vnl_F64ArrayObject *arr = (void *)vnl_value_as_object(val);
+        fprintf(out, "vnl_aot_array(exec, (Vnl_Value[]){ ");
+        for (size_t i = 0; i < arr->len; ++i) {
+            emit_c_value(out, vnl_value_from_number(arr->items[i]));
+            fprintf(out, i + 1 < arr->len ? ", " : " ");
+        }
+        fprintf(out, "}, %zu)", arr->len);
+    } else {
+        const Vnl_ArrayObject *arr = (void *)vnl_value_as_object(val);
+        if (arr->len == 0) {
+            fprintf(out, "vnl_aot_array(exec, nullptr, 0)");
+            return;
+        }
+        fprintf(out, "vnl_aot_array(exec, (Vnl_Value[]){ ");
+        for (size_t i = 0; i < arr->len; ++i) {
+            emit_c_value(out, arr->items[i]);
+            fprintf(out, i + 1 < arr->len ? ", " : " ");
+        }
+        fprintf(out, "}, %zu)", arr->len);
+    }
+}
+
+// Pushes a constant into s[depth]. Object constants are built once, into K[*nconsts].
+void emit_c_const(FILE *out, Vnl_Value val, size_t depth, size_t *nconsts) {
+    if (vnl_value_is_number(val)) {
+        fprintf(out, "    s[%zu] = ", depth);
+        emit_c_value(out, val);
+        fprintf(out, "; // %g\n", vnl_value_as_number(val));
+    } else {
+        fprintf(out, "    vnl_value_acquire(K[%zu]);\n", *nconsts);
+        fprintf(out, "    s[%zu] = K[%zu];\n", depth, *nconsts);
+        (*nconsts)++;
+    }
+}
+
+// s[dst] = s[a] op s[b], consuming both. On errors the values below `keep` are released.
+void emit_c_binop(FILE *out, OpKind op, size_t a, size_t b, size_t dst, size_t keep) {
+    static const char *const C_OPS[] = {
+        [BINOP_ADD] = "+", [BINOP_SUB] = "-", [BINOP_MUL] = "*", [BINOP_DIV] = "/", [BINOP_MOD] = "%",
+    };
+    fprintf(out, "    if (vnl_value_is_number(s[%zu]) && vnl_value_is_number(s[%zu])) {\n", a, b);
+    if (op == BINOP_MOD) {
+        fprintf(out, "        s[%zu] = vnl_value_from_number(fmod(vnl_value_as_number(s[%zu]), vnl_value_as_number(s[%zu])));\n", dst, a, b);
+    } else {
+        fprintf(out, "        s[%zu] = vnl_value_from_number(vnl_value_as_number(s[%zu]) %s vnl_value_as_number(s[%zu]));\n", dst, a, C_OPS[op], b);
+    }
+    fprintf(out, "    } else if (vnl_aot_binop(exec, '%s', s[%zu], s[%zu], &s[%zu])) {\n", C_OPS[op], a, b, dst);
+    fprintf(out, "        return vnl_aot_drop(s, %zu);\n", keep);
+    fprintf(out, "    }\n");
+}
+
+// Translates the stack code of one statement into a C function. The stack becomes a
+// local array whose depth at every instruction is known here, so the C compiler can
+// keep it in registers; the generated code has no dispatch and no operand decoding.
+void emit_c_statement(FILE *out, size_t index, Vnl_String source, const Code *code, size_t *nconsts) {
+    fprintf(out, "// ");
+    emit_c_string(out, source);
+    fprintf(out, "\nstatic bool statement_%zu(Vnl_Executor *exec, Vnl_Value *result) {\n", index);
+    // The K and LOAD superinstructions need a scratch slot above the top.
+    fprintf(out, "    Vnl_Value s[%zu];\n", code_max_depth(code) + 1);
+
+    size_t d = 0;
+    for (size_t i = 0; i < code->len; ++i) {
+        const Instruction *instr = &code->items[i];
+        VMOpcode opcode = instr->opcode;
+        switch (opcode) {
+            case VM_PUT: {
+                emit_c_const(out, instr->arg, d++, nconsts);
+            } break;
+
+            case VM_LOAD: {
+                fprintf(out, "    if (vnl_aot_load(exec, VARS[%zu], &s[%zu])) return vnl_aot_drop(s, %zu);\n", instr->slot, d, d);
+                d++;
+            } break;
+
+            case VM_STORE: {
+                fprintf(out, "    if (vnl_aot_force(exec, &s[%zu], 1)) return vnl_aot_drop(s, %zu);\n", d - 1, d);
+                fprintf(out, "    vnl_aot_store(exec, VARS[%zu], s[%zu]);\n", instr->slot, --d);
+            } break;
+
+            case VM_STOREKEEP: {
+                fprintf(out, "    if (vnl_aot_force(exec, &s[%zu], 1)) return vnl_aot_drop(s, %zu);\n", d - 1, d);
+                fprintf(out, "    vnl_value_acquire(s[%zu]);\n", d - 1);
+                fprintf(out, "    vnl_aot_store(exec, VARS[%zu], s[%zu]);\n", instr->slot, d - 1);
+            } break;
+
+            case VM_DUP: {
+                fprintf(out, "    vnl_value_acquire(s[%zu]);\n", d - 1);
+                fprintf(out, "    s[%zu] = s[%zu];\n", d, d - 1);
+                d++;
+            } break;
+
+            case VM_ROT: {
+                fprintf(out, "    { Vnl_Value t = s[%zu]; s[%zu] = s[%zu]; s[%zu] = t; }\n", d - 1, d - 1, d - 2, d - 2);
+            } break;
+
+            case VM_MAKEARR: {
+                size_t n = instr->makearr_len;
+                fprintf(out, "    if (vnl_aot_force(exec, &s[%zu], %zu)) return vnl_aot_drop(s, %zu);\n", d - n, n, d);
+                fprintf(out, "    s[%zu] = vnl_aot_array(exec, &s[%zu], %zu);\n", d - n, d - n, n);
+                d = d - n + 1;
+            } break;
+
+            case VM_INDEX: {
+                fprintf(out, "    if (vnl_aot_index(exec, s[%zu], s[%zu], &s[%zu])) return vnl_aot_drop(s, %zu);\n", d - 2, d - 1, d - 2, d - 2);
+                d--;
+            } break;
+
+            case VM_SLICE: {
+                size_t n = 1 + slice_parts_count(instr->slice_parts);
+                fprintf(out, "    if (vnl_aot_slice(exec, &s[%zu], %u, &s[%zu])) return vnl_aot_drop(s, %zu);\n", d - n, instr->slice_parts, d - n, d - n);
+                d = d - n + 1;
+            } break;
+
+            case VM_ADD: case VM_SUB: case VM_MUL: case VM_DIV: case VM_MOD: {
+                emit_c_binop(out, opcode - VM_ADD + BINOP_ADD, d - 1, d - 2, d - 2, d - 2);
+                d--;
+            } break;
+
+            case VM_ADDK: case VM_SUBK: case VM_MULK: case VM_DIVK: case VM_MODK: {
+                emit_c_const(out, instr->arg, d, nconsts);
+                emit_c_binop(out, opcode - VM_ADDK + BINOP_ADD, d - 1, d, d - 1, d - 1);
+            } break;
+
+            case VM_LOADADD: case VM_LOADSUB: case VM_LOADMUL: case VM_LOADDIV: case VM_LOADMOD: {
+                fprintf(out, "    if (vnl_aot_load(exec, VARS[%zu], &s[%zu])) return vnl_aot_drop(s, %zu);\n", instr->slot, d, d);
+                emit_c_binop(out, opcode - VM_LOADADD + BINOP_ADD, d - 1, d, d - 1, d - 1);
+            } break;
+
+            default: {
+                fprintf(out, "#error \"unsupported instruction\"\n");
+            } break;
+        }
+    }
+
+    if (d > 1) {
+        fprintf(out, "    vnl_aot_drop(s, %zu);\n", d - 1);
+    }
+    if (d) {
+        fprintf(out, "    *result = s[%zu];\n", d - 1);
+    }
+    fprintf(out, "    return false;\n}\n\n");
+}
+
+void code_emit_consts(FILE *out, const Code *code, size_t *nconsts) {
+    for (size_t i = 0; i < code->len; ++i) {
+        const Instruction *instr = &code->items[i];
+        if (vm_operand_kind(instr->opcode) == OPERAND_CONST && !vnl_value_is_number(instr->arg)) {
+            fprintf(out, "    K[%zu] = ", (*nconsts)++);
+            emit_c_value(out, instr->arg);
+            fprintf(out, ";\n");
+        }
+    }
+}
+
+// Compiles a script, one statement per line, into the source of a standalone C program
+// that runs it like the REPL would and links against the runtime in src/. Returns true
+// on syntax errors, which are reported with their line number.
+bool vnl_exec_emit_c(Vnl_Executor *exec, Vnl_String source, FILE *out) {
+    Vnl_Heap *prev = vnl_heap_enter(&exec->heap);
+    size_t len = 0, cap = 16;
+    Code *codes = vnl_malloc(sizeof(*codes) * cap);
+    Vnl_String *lines = vnl_malloc(sizeof(*lines) * cap);
+    bool failed = false;
+
+    size_t lineno = 0;
+    while (source.len && !failed) {
+        const char *eol = memchr(source.chars, '\n', source.len);
+        size_t linelen = eol ? (size_t)(eol - source.chars) : source.len;
+        Vnl_String line = vnl_string_trim((Vnl_String){ source.chars, linelen });
+        source = vnl_string_lshiftn(source, linelen);
+        source = vnl_string_lshift(source);
+        lineno++;
+        if (line.len == 0) {
+            continue;
+        }
+
+        ASTNode *ast = nullptr;
+        if (exec_parse_source(exec, line, COMPILE_OPTIMIZE, false, false, &ast)) {
+            printf(VNL_ANSICOL_RED "Error: in line %zu\n" VNL_ANSICOL_RESET, lineno);
+            failed = true;
+            break;
+        }
+        if (len == cap) {
+            cap *= 2;
+            codes = vnl_realloc(codes, sizeof(*codes) * cap);
+            lines = vnl_realloc(lines, sizeof(*lines) * cap);
+        }
+        codes[len] = (Code){};
+        ParseError err = exec_compile_ast(exec, ast, &codes[len]);
+        if (err) {
+            print_parseerr(err, line, nullptr);
+            printf(VNL_ANSICOL_RED "Error: in line %zu\n" VNL_ANSICOL_RESET, lineno);
+            code_free(&codes[len]);
+            vnl_arena_reset(&exec->arena);
+            failed = true;
+            break;
+        }
+        code_optimize(&codes[len]);
+        lines[len++] = line;
+        vnl_arena_reset(&exec->arena);
+    }
+
+    if (!failed) {
+        size_t nconsts = 0;
+        for (size_t i = 0; i < len; ++i) {
+            for (size_t j = 0; j < codes[i].len; ++j) {
+                const Instruction *instr = &codes[i].items[j];
+                nconsts += vm_operand_kind(instr->opcode) == OPERAND_CONST && !vnl_value_is_number(instr->arg);
+            }
+        }
+        size_t nvars = exec->vars->len;
+
+        fprintf(out, "// Generated by vinyl --emit-c. Link against src/*.c except main.c.\n\n");
+        fprintf(out, "#include \"executor.h\"\n#include <math.h>\n#include <stdint.h>\n\n");
+        fprintf(out, "static size_t VARS[%zu];\n", nvars ? nvars : 1);
+        fprintf(out, "static Vnl_Value K[%zu];\n\n", nconsts ? nconsts : 1);
+
+        size_t k = 0;
+        for (size_t i = 0; i < len; ++i) {
+            emit_c_statement(out, i, lines[i], &codes[i], &k);
+        }
+
+        fprintf(out, "int main() {\n");
+        fprintf(out, "    Vnl_Executor *exec = vnl_exec_new();\n");
+        for (size_t i = 0; i < nvars; ++i) {
+            fprintf(out, "    VARS[%zu] = vnl_aot_resolve(exec, ", i);
+            emit_c_string(out, vnl_symbol_str(exec->vars->names[i]));
+            fprintf(out, ");\n");
+        }
+        k = 0;
+        for (size_t i = 0; i < len; ++i) {
+            code_emit_consts(out, &codes[i], &k);
+        }
+        fprintf(out, "\n    bool failed = false;\n");
+        for (size_t i = 0; i < len; ++i) {
+            fprintf(out, "    failed |= vnl_aot_statement(exec, statement_%zu);\n", i);
+        }
+        fprintf(out, "\n    vnl_aot_drop(K, %zu);\n", nconsts);
+        fprintf(out, "    vnl_exec_free(exec);\n");
+        fprintf(out, "    return failed;\n}\n");
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        code_free(&codes[i]);
+    }
+    vnl_free(codes);
+    vnl_free(lines);
+    vnl_heap_leave(prev);
+    return failed;
+}
@@ -2,21 +2,68 @@
 #define __VINYL_EXECUTOR_H__
 
 
+#include "common.h"
 #include "object.h"
+#include "pool.h"
 #include "string.h"
+#include "value.h"
 
 
 typedef struct Vnl_Executor Vnl_Executor;
+typedef struct Vnl_Program Vnl_Program;
+typedef struct Vnl_CompileCacheStats Vnl_CompileCacheStats;
+
+struct Vnl_CompileCacheStats {
+	size_t entries;
+	size_t capacity;
+	size_t hits;
+	size_t misses;
+};
 
 
 Vnl_Executor *vnl_exec_new();
 void vnl_exec_free(Vnl_Executor *);
 
-void vnl_exec_setvar(Vnl_Executor *, Vnl_String, Vnl_Object *);
-Vnl_Object *vnl_exec_getvar(Vnl_Executor *, Vnl_String);
+void vnl_exec_setvar(Vnl_Executor *, Vnl_String, Vnl_Value);
+Vnl_Value vnl_exec_getvar(Vnl_Executor *, Vnl_String);
 void vnl_exec_delvar(Vnl_Executor *, Vnl_String);
 
+Vnl_ObjectPoolStats vnl_exec_pool_stats(const Vnl_Executor *);
+Vnl_Heap vnl_exec_heap_stats(const Vnl_Executor *);
+void vnl_exec_set_memory_limit(Vnl_Executor *, size_t);
+Vnl_CompileCacheStats vnl_exec_cache_stats(const Vnl_Executor *);
+
 bool vnl_exec_string(Vnl_Executor *, Vnl_String);
 
+// A program is compiled once and may be run any number of times, but only on the
+// executor that compiled it, and must be freed before that executor.
+// vnl_exec_compile returns nullptr on syntax errors. vnl_exec_run returns true on error;
+// on success `result` (if given) receives the statement's value, which the caller must
+// release with vnl_value_release. Running a program may rewrite its instructions into
+// type-specialised forms.
+Vnl_Program *vnl_exec_compile(Vnl_Executor *, Vnl_String);
+bool vnl_exec_run(Vnl_Executor *, Vnl_Program *, Vnl_Value *);
+void vnl_program_free(Vnl_Program *);
+
+// Translates a script (one statement per line) into the C source of a standalone program.
+// Returns true on syntax errors.
+bool vnl_exec_emit_c(Vnl_Executor *, Vnl_String, FILE *);
+
+// Runtime used by the code vnl_exec_emit_c generates. Every value passed to or returned
+// from these holds one reference. The functions returning bool return true on error.
+typedef bool(*Vnl_AotStatement)(Vnl_Executor *, Vnl_Value *);
+
+size_t vnl_aot_resolve(Vnl_Executor *, Vnl_CString);
+Vnl_Value vnl_aot_string(Vnl_Executor *, const char *, size_t);
+Vnl_Value vnl_aot_array(Vnl_Executor *, const Vnl_Value *, size_t);
+bool vnl_aot_load(Vnl_Executor *, size_t, Vnl_Value *);
+void vnl_aot_store(Vnl_Executor *, size_t, Vnl_Value);
+bool vnl_aot_binop(Vnl_Executor *, char, Vnl_Value, Vnl_Value, Vnl_Value *);
+bool vnl_aot_index(Vnl_Executor *, Vnl_Value, Vnl_Value, Vnl_Value *);
+bool vnl_aot_slice(Vnl_Executor *, Vnl_Value *, unsigned, Vnl_Value *);
+bool vnl_aot_force(Vnl_Executor *, Vnl_Value *, size_t);
+bool vnl_aot_drop(Vnl_Value *, size_t);
+bool vnl_aot_statement(Vnl_Executor *, Vnl_AotStatement);
+
 
 #endif // __VINYL_EXECUTOR_H__
@@ -0,0 +1,103 @@
+
+#include "intern.h"
+#include "common.h"
+#include "string.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <xxhash.h>
+
+
+typedef struct Vnl_InternTable Vnl_InternTable;
+
+struct Vnl_InternTable {
+	const Vnl_Symbol **slots;
+	size_t len;
+	size_t cap;
+};
+
+
+static const size_t INITIAL_CAPACITY = 256;
+static const size_t HASH_SEED = 0;
+
+// Symbols are shared by every executor and live for the whole process. Executors may run
+// on different threads, and interning can grow the table under a concurrent lookup, so
+// every access holds the lock. Symbols themselves never move once made.
+static Vnl_InternTable INTERN_TABLE = { 0 };
+static pthread_mutex_t INTERN_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+
+static const Vnl_Symbol **vnl_intern_probe(Vnl_InternTable *self, Vnl_String str, uint64_t hash) {
+	size_t mask = self->cap - 1;
+	for (size_t idx = hash & mask;; idx = (idx + 1) & mask) {
+		const Vnl_Symbol **slot = &self->slots[idx];
+		if (*slot == nullptr) {
+			return slot;
+		}
+		if ((*slot)->hash == hash && vnl_string_cmpeq_s(vnl_symbol_str(*slot), str)) {
+			return slot;
+		}
+	}
+}
+
+static void vnl_intern_grow(Vnl_InternTable *self) {
+	Vnl_InternTable new_self = {
+		.slots = vnl_malloc(sizeof(*self->slots) * (self->cap ? self->cap * 2 : INITIAL_CAPACITY)),
+		.len = self->len,
+		.cap = self->cap ? self->cap * 2 : INITIAL_CAPACITY,
+	};
+	for (size_t i = 0; i < self->cap; ++i) {
+		const Vnl_Symbol *sym = self->slots[i];
+		if (sym) {
+			*vnl_intern_probe(&new_self, vnl_symbol_str(sym), sym->hash) = sym;
+		}
+	}
+	vnl_free(self->slots);
+	*self = new_self;
+}
+
+
+// The table outlives any executor, so its memory is never charged to one.
+const Vnl_Symbol *vnl_intern_s(Vnl_String str) {
+	Vnl_InternTable *self = &INTERN_TABLE;
+	uint64_t hash = XXH64(str.chars, str.len, HASH_SEED);
+	Vnl_Heap *heap = vnl_heap_enter(nullptr);
+	pthread_mutex_lock(&INTERN_LOCK);
+	if ((self->len + 1) * 2 > self->cap) {
+		vnl_intern_grow(self);
+	}
+
+	const Vnl_Symbol **slot = vnl_intern_probe(self, str, hash);
+	if (*slot == nullptr) {
+		Vnl_Symbol *sym = vnl_malloc(sizeof(*sym) + str.len);
+		sym->hash = hash;
+		sym->len = str.len;
+		memcpy(sym->chars, str.chars, str.len);
+		*slot = sym;
+		self->len++;
+	}
+	const Vnl_Symbol *sym = *slot;
+	pthread_mutex_unlock(&INTERN_LOCK);
+	vnl_heap_leave(heap);
+	return sym;
+}
+
+const Vnl_Symbol *vnl_intern_c(Vnl_CString cstr) {
+	return vnl_intern_s(vnl_string_from_c(cstr));
+}
+
+const Vnl_Symbol *vnl_intern_find_s(Vnl_String str) {
+	Vnl_InternTable *self = &INTERN_TABLE;
+	uint64_t hash = XXH64(str.chars, str.len, HASH_SEED);
+	pthread_mutex_lock(&INTERN_LOCK);
+	const Vnl_Symbol *sym = self->cap ? *vnl_intern_probe(self, str, hash) : nullptr;
+	pthread_mutex_unlock(&INTERN_LOCK);
+	return sym;
+}
+
+
+Vnl_String vnl_symbol_str(const Vnl_Symbol *self) {
+	return (Vnl_String){ self->chars, self->len };
+}
@@ -0,0 +1,27 @@
+#ifndef __VINYL_INTERN_H__
+#define __VINYL_INTERN_H__
+
+#include "string.h"
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef struct Vnl_Symbol Vnl_Symbol;
+
+// Canonical, immutable copy of a byte string. Two symbols are equal iff their
+// pointers are equal; the hash is computed once when the symbol is created.
+struct Vnl_Symbol {
+	uint64_t hash;
+	size_t len;
+	char chars[];
+};
+
+
+const Vnl_Symbol *vnl_intern_s(Vnl_String);
+const Vnl_Symbol *vnl_intern_c(Vnl_CString);
+const Vnl_Symbol *vnl_intern_find_s(Vnl_String);
+
+Vnl_String vnl_symbol_str(const Vnl_Symbol *);
+
+
+#endif // __VINYL_INTERN_H__
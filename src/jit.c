@@ -0,0 +1,416 @@
+#include "jit.h"
+#include "common.h"
+#include "value.h"
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define VNL_JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+typedef uint64_t (*Vnl_JitEntry)(Vnl_Value *, Vnl_Value *);
+
+struct Vnl_JitCode {
+	void *mem;
+	size_t mapped;
+	size_t size;
+	size_t nresults;
+	Vnl_JitEntry entry;
+};
+
+
+size_t vnl_jit_result_count(const Vnl_JitCode *self) {
+	return self->nresults;
+}
+
+size_t vnl_jit_code_size(const Vnl_JitCode *self) {
+	return self->size;
+}
+
+
+#ifdef VNL_JIT_X86_64
+
+// A template JIT: every op is pasted in as a fixed sequence of x86-64 instructions,
+// with no register allocation. Stack values live in the native frame at offsets fixed
+// at compile time, so SWAP just renames two of them. Arithmetic is done with SSE2
+// scalar doubles, which round exactly like the interpreter's C arithmetic; MOD calls
+// fmod like the interpreter does.
+//
+// The generated function is `uint64_t f(Vnl_Value *vars, Vnl_Value *results)` and
+// returns non-zero if a guard failed. All guards run before the first store, so a
+// failing guard leaves no side effects and the caller can simply interpret instead.
+//
+// Register use: rbx = vars, r12 = results, r13 = QNAN, r14 = TAG_OBJ, r15 = CANON_NAN,
+// rax and rcx are scratch. The constants have to be in callee-saved registers, since
+// they must survive the calls to fmod.
+
+typedef struct {
+	uint8_t *bytes;
+	size_t len;
+	size_t cap;
+	size_t *bails;
+	size_t nbails;
+	size_t bails_cap;
+} Emitter;
+
+static void emit(Emitter *e, const void *bytes, size_t n) {
+	if (e->len + n > e->cap) {
+		size_t newcap = e->cap ? e->cap * 2 : 256;
+		while (newcap < e->len + n) {
+			newcap *= 2;
+		}
+		e->bytes = vnl_realloc(e->bytes, newcap);
+		e->cap = newcap;
+	}
+	memcpy(e->bytes + e->len, bytes, n);
+	e->len += n;
+}
+
+#define EMIT(e, ...) emit((e), (const uint8_t[]){ __VA_ARGS__ }, sizeof((const uint8_t[]){ __VA_ARGS__ }))
+
+static void emit_u32(Emitter *e, uint32_t x) {
+	emit(e, &x, sizeof(x));
+}
+
+static void emit_u64(Emitter *e, uint64_t x) {
+	emit(e, &x, sizeof(x));
+}
+
+// je <bail>; the target is patched in once the bail-out block is placed.
+static void emit_je_bail(Emitter *e) {
+	EMIT(e, 0x0f, 0x84);
+	if (e->nbails == e->bails_cap) {
+		e->bails_cap = e->bails_cap ? e->bails_cap * 2 : 16;
+		e->bails = vnl_realloc(e->bails, e->bails_cap * sizeof(*e->bails));
+	}
+	e->bails[e->nbails++] = e->len;
+	emit_u32(e, 0);
+}
+
+// mov rax, [rbx + 8*slot]
+static void emit_load_var(Emitter *e, size_t slot) {
+	EMIT(e, 0x48, 0x8b, 0x83);
+	emit_u32(e, (uint32_t)(slot * 8));
+}
+
+// mov [rbx + 8*slot], rax
+static void emit_store_var(Emitter *e, size_t slot) {
+	EMIT(e, 0x48, 0x89, 0x83);
+	emit_u32(e, (uint32_t)(slot * 8));
+}
+
+// mov rax, [rsp + 8*pos]
+static void emit_load_frame(Emitter *e, size_t pos) {
+	EMIT(e, 0x48, 0x8b, 0x84, 0x24);
+	emit_u32(e, (uint32_t)(pos * 8));
+}
+
+// mov [rsp + 8*pos], rax
+static void emit_store_frame(Emitter *e, size_t pos) {
+	EMIT(e, 0x48, 0x89, 0x84, 0x24);
+	emit_u32(e, (uint32_t)(pos * 8));
+}
+
+// Same as vnl_value_from_number: a NaN that looks tagged becomes the canonical NaN.
+static void emit_canonicalize(Emitter *e) {
+	EMIT(e,
+		0x48, 0x89, 0xc1,  // mov rcx, rax
+		0x4c, 0x21, 0xe9,  // and rcx, r13
+		0x4c, 0x39, 0xe9,  // cmp rcx, r13
+		0x75, 0x03,        // jne +3
+		0x4c, 0x89, 0xf8   // mov rax, r15
+	);
+}
+
+// movsd xmm<reg>, [rsp + 8*pos]
+static void emit_movsd_load(Emitter *e, unsigned reg, size_t pos) {
+	EMIT(e, 0xf2, 0x0f, 0x10, (uint8_t)(0x84 | (reg << 3)), 0x24);
+	emit_u32(e, (uint32_t)(pos * 8));
+}
+
+// movsd [rsp + 8*pos], xmm0
+static void emit_movsd_store(Emitter *e, size_t pos) {
+	EMIT(e, 0xf2, 0x0f, 0x11, 0x84, 0x24);
+	emit_u32(e, (uint32_t)(pos * 8));
+}
+
+static void emit_epilogue(Emitter *e, uint32_t frame) {
+	EMIT(e, 0x48, 0x81, 0xc4);  // add rsp, frame
+	emit_u32(e, frame);
+	EMIT(e,
+		0x41, 0x5f,  // pop r15
+		0x41, 0x5e,  // pop r14
+		0x41, 0x5d,  // pop r13
+		0x41, 0x5c,  // pop r12
+		0x5b,        // pop rbx
+		0xc3         // ret
+	);
+}
+
+static bool slot_listed(const size_t *slots, size_t len, size_t slot) {
+	for (size_t i = 0; i < len; ++i) {
+		if (slots[i] == slot) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Checks the stack discipline and works out which variables need guarding: loads of a
+// variable not stored earlier in the program must see a number, and stores must not
+// overwrite an object (that would need a release). Returns false for malformed code.
+static bool jit_analyse(
+	const Vnl_JitOp *ops, size_t len,
+	size_t *loads, size_t *nloads,
+	size_t *stores, size_t *nstores,
+	size_t *max_depth, size_t *final_depth
+) {
+	size_t depth = 0;
+	*nloads = *nstores = *max_depth = 0;
+	for (size_t i = 0; i < len; ++i) {
+		const Vnl_JitOp *op = &ops[i];
+		if ((op->kind == VNL_JITOP_LOAD || op->kind == VNL_JITOP_STORE) && op->slot > INT32_MAX / 8) {
+			return false;
+		}
+		switch (op->kind) {
+			case VNL_JITOP_CONST:
+				depth++;
+				break;
+			case VNL_JITOP_LOAD:
+				if (!slot_listed(stores, *nstores, op->slot) && !slot_listed(loads, *nloads, op->slot)) {
+					loads[(*nloads)++] = op->slot;
+				}
+				depth++;
+				break;
+			case VNL_JITOP_STORE:
+				if (depth < 1) return false;
+				if (!slot_listed(stores, *nstores, op->slot)) {
+					stores[(*nstores)++] = op->slot;
+				}
+				depth--;
+				break;
+			case VNL_JITOP_DUP:
+				if (depth < 1) return false;
+				depth++;
+				break;
+			case VNL_JITOP_SWAP:
+				if (depth < 2) return false;
+				break;
+			case VNL_JITOP_ADD:
+			case VNL_JITOP_SUB:
+			case VNL_JITOP_MUL:
+			case VNL_JITOP_DIV:
+			case VNL_JITOP_MOD:
+				if (depth < 2) return false;
+				depth--;
+				break;
+			default:
+				return false;
+		}
+		if (depth > *max_depth) {
+			*max_depth = depth;
+		}
+	}
+	*final_depth = depth;
+	return *max_depth <= INT32_MAX / 16;
+}
+
+static void jit_emit(Emitter *e, const Vnl_JitOp *ops, size_t len, size_t *pos, uint32_t frame) {
+	size_t depth = 0;
+	for (size_t i = 0; i < len; ++i) {
+		const Vnl_JitOp *op = &ops[i];
+		switch (op->kind) {
+			case VNL_JITOP_CONST: {
+				Vnl_Value val = vnl_value_from_number(op->num);
+				EMIT(e, 0x48, 0xb8);  // movabs rax, imm64
+				emit_u64(e, val.bits);
+				emit_store_frame(e, pos[depth++]);
+			} break;
+
+			case VNL_JITOP_LOAD: {
+				emit_load_var(e, op->slot);
+				emit_store_frame(e, pos[depth++]);
+			} break;
+
+			case VNL_JITOP_STORE: {
+				emit_load_frame(e, pos[--depth]);
+				emit_canonicalize(e);
+				emit_store_var(e, op->slot);
+			} break;
+
+			case VNL_JITOP_DUP: {
+				emit_load_frame(e, pos[depth - 1]);
+				emit_store_frame(e, pos[depth++]);
+			} break;
+
+			case VNL_JITOP_SWAP: {
+				size_t tmp = pos[depth - 1];
+				pos[depth - 1] = pos[depth - 2];
+				pos[depth - 2] = tmp;
+			} break;
+
+			case VNL_JITOP_MOD: {
+				emit_movsd_load(e, 0, pos[depth - 1]);
+				emit_movsd_load(e, 1, pos[depth - 2]);
+				EMIT(e, 0x48, 0xb8);  // movabs rax, fmod
+				emit_u64(e, (uint64_t)(uintptr_t)&fmod);
+				EMIT(e, 0xff, 0xd0);  // call rax
+				emit_movsd_store(e, pos[depth - 2]);
+				depth--;
+			} break;
+
+			default: {
+				static const uint8_t SSE_OPS[] = {
+					[VNL_JITOP_ADD] = 0x58,
+					[VNL_JITOP_SUB] = 0x5c,
+					[VNL_JITOP_MUL] = 0x59,
+					[VNL_JITOP_DIV] = 0x5e,
+				};
+				emit_movsd_load(e, 0, pos[depth - 1]);
+				// <op>sd xmm0, [rsp + 8*pos]
+				EMIT(e, 0xf2, 0x0f, SSE_OPS[op->kind], 0x84, 0x24);
+				emit_u32(e, (uint32_t)(pos[depth - 2] * 8));
+				emit_movsd_store(e, pos[depth - 2]);
+				depth--;
+			} break;
+		}
+	}
+
+	for (size_t i = 0; i < depth; ++i) {
+		emit_load_frame(e, pos[i]);
+		emit_canonicalize(e);
+		EMIT(e, 0x49, 0x89, 0x84, 0x24);  // mov [r12 + 8*i], rax
+		emit_u32(e, (uint32_t)(i * 8));
+	}
+	EMIT(e, 0x31, 0xc0);  // xor eax, eax
+	emit_epilogue(e, frame);
+}
+
+Vnl_JitCode *vnl_jit_compile(const Vnl_JitOp *ops, size_t len) {
+	size_t *loads = vnl_malloc(sizeof(*loads) * (len ? len : 1));
+	size_t *stores = vnl_malloc(sizeof(*stores) * (len ? len : 1));
+	size_t nloads, nstores, max_depth, final_depth;
+	if (!jit_analyse(ops, len, loads, &nloads, stores, &nstores, &max_depth, &final_depth)) {
+		vnl_free(loads);
+		vnl_free(stores);
+		return nullptr;
+	}
+
+	// Stack position i starts out in frame slot i; SWAP permutes the mapping.
+	size_t *pos = vnl_malloc(sizeof(*pos) * (max_depth ? max_depth : 1));
+	for (size_t i = 0; i < max_depth; ++i) {
+		pos[i] = i;
+	}
+	// Five pushes on top of the return address leave rsp 16-byte aligned for fmod.
+	uint32_t frame = (uint32_t)((max_depth * 8 + 15) & ~(size_t)15);
+
+	Emitter e = {};
+	EMIT(&e,
+		0x53,              // push rbx
+		0x41, 0x54,        // push r12
+		0x41, 0x55,        // push r13
+		0x41, 0x56,        // push r14
+		0x41, 0x57,        // push r15
+		0x48, 0x89, 0xfb,  // mov rbx, rdi
+		0x49, 0x89, 0xf4   // mov r12, rsi
+	);
+	EMIT(&e, 0x48, 0x81, 0xec);  // sub rsp, frame
+	emit_u32(&e, frame);
+	EMIT(&e, 0x49, 0xbd);  // movabs r13, QNAN
+	emit_u64(&e, VNL_VALUE_QNAN);
+	EMIT(&e, 0x49, 0xbe);  // movabs r14, TAG_OBJ
+	emit_u64(&e, VNL_VALUE_TAG_OBJ);
+	EMIT(&e, 0x49, 0xbf);  // movabs r15, CANON_NAN
+	emit_u64(&e, VNL_VALUE_CANON_NAN);
+
+	for (size_t i = 0; i < nloads; ++i) {
+		emit_load_var(&e, loads[i]);
+		EMIT(&e, 0x4c, 0x21, 0xe8, 0x4c, 0x39, 0xe8);  // and rax, r13; cmp rax, r13
+		emit_je_bail(&e);
+	}
+	for (size_t i = 0; i < nstores; ++i) {
+		emit_load_var(&e, stores[i]);
+		EMIT(&e, 0x4c, 0x21, 0xf0, 0x4c, 0x39, 0xf0);  // and rax, r14; cmp rax, r14
+		emit_je_bail(&e);
+	}
+
+	jit_emit(&e, ops, len, pos, frame);
+
+	size_t bail = e.len;
+	EMIT(&e, 0xb8, 0x01, 0x00, 0x00, 0x00);  // mov eax, 1
+	emit_epilogue(&e, frame);
+	for (size_t i = 0; i < e.nbails; ++i) {
+		int32_t rel = (int32_t)(bail - (e.bails[i] + 4));
+		memcpy(e.bytes + e.bails[i], &rel, sizeof(rel));
+	}
+
+	vnl_free(loads);
+	vnl_free(stores);
+	vnl_free(pos);
+	vnl_free(e.bails);
+
+	// Written while writable, then flipped to executable: never both at once.
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t mapped = (e.len + page - 1) / page * page;
+	void *mem = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		vnl_free(e.bytes);
+		return nullptr;
+	}
+	memcpy(mem, e.bytes, e.len);
+	vnl_free(e.bytes);
+	if (mprotect(mem, mapped, PROT_READ | PROT_EXEC)) {
+		munmap(mem, mapped);
+		return nullptr;
+	}
+
+	Vnl_JitCode *self = vnl_malloc(sizeof(*self));
+	*self = (Vnl_JitCode){
+		.mem = mem,
+		.mapped = mapped,
+		.size = e.len,
+		.nresults = final_depth,
+		.entry = (Vnl_JitEntry)mem,
+	};
+	return self;
+}
+
+void vnl_jit_free(Vnl_JitCode *self) {
+	if (self == nullptr) {
+		return;
+	}
+	munmap(self->mem, self->mapped);
+	vnl_free(self);
+}
+
+bool vnl_jit_run(const Vnl_JitCode *self, Vnl_Value *vars, Vnl_Value *results) {
+	return self->entry(vars, results) == 0;
+}
+
+#undef EMIT
+
+#else
+
+Vnl_JitCode *vnl_jit_compile(const Vnl_JitOp *ops, size_t len) {
+	(void)ops;
+	(void)len;
+	return nullptr;
+}
+
+void vnl_jit_free(Vnl_JitCode *self) {
+	(void)self;
+}
+
+bool vnl_jit_run(const Vnl_JitCode *self, Vnl_Value *vars, Vnl_Value *results) {
+	(void)self;
+	(void)vars;
+	(void)results;
+	return false;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef __VINYL_JIT_H__
+#define __VINYL_JIT_H__
+
+#include "value.h"
+#include <stddef.h>
+
+
+typedef enum Vnl_JitOpKind Vnl_JitOpKind;
+typedef struct Vnl_JitOp Vnl_JitOp;
+typedef struct Vnl_JitCode Vnl_JitCode;
+
+// The JIT works on a tiny stack language of its own, so it doesn't depend on how the
+// executor encodes its bytecode. SWAP only renames stack slots at compile time and
+// costs nothing at run time. Binary ops take their left operand from the top.
+enum Vnl_JitOpKind {
+	VNL_JITOP_CONST,
+	VNL_JITOP_LOAD,
+	VNL_JITOP_STORE,
+	VNL_JITOP_DUP,
+	VNL_JITOP_SWAP,
+	VNL_JITOP_ADD,
+	VNL_JITOP_SUB,
+	VNL_JITOP_MUL,
+	VNL_JITOP_DIV,
+	VNL_JITOP_MOD,
+};
+
+struct Vnl_JitOp {
+	Vnl_JitOpKind kind;
+	union {
+		double num;
+		size_t slot;
+	};
+};
+
+
+// Returns nullptr when the JIT is not available on this platform or the ops are not
+// a well-formed program.
+Vnl_JitCode *vnl_jit_compile(const Vnl_JitOp *, size_t);
+void vnl_jit_free(Vnl_JitCode *);
+
+// Runs the code against the variable slots in `vars`, writing the values left on the
+// stack to `results`. Every variable the code loads must hold a number and every one it
+// stores must not hold an object; otherwise nothing is touched and false is returned.
+bool vnl_jit_run(const Vnl_JitCode *, Vnl_Value *vars, Vnl_Value *results);
+size_t vnl_jit_result_count(const Vnl_JitCode *);
+size_t vnl_jit_code_size(const Vnl_JitCode *);
+
+
+#endif // __VINYL_JIT_H__
@@ -0,0 +1,184 @@
+#include "kernels.h"
+#include <math.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define VNL_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+
+typedef void(*Vnl_KernelVV)(Vnl_KernelOp, double *, const double *, const double *, size_t);
+typedef void(*Vnl_KernelVS)(Vnl_KernelOp, double *, const double *, double, size_t);
+typedef void(*Vnl_KernelSV)(Vnl_KernelOp, double *, double, const double *, size_t);
+
+typedef struct {
+	Vnl_KernelVV vv;
+	Vnl_KernelVS vs;
+	Vnl_KernelSV sv;
+} Vnl_KernelSet;
+
+
+// The scalar loops double as the tails of the vector ones. There is no vector fmod, so
+// MOD always runs here.
+static void scalar_vv(Vnl_KernelOp op, double *dst, const double *a, const double *b, size_t n) {
+	switch (op) {
+		case VNL_KERNEL_ADD: for (size_t i = 0; i < n; ++i) dst[i] = a[i] + b[i]; break;
+		case VNL_KERNEL_SUB: for (size_t i = 0; i < n; ++i) dst[i] = a[i] - b[i]; break;
+		case VNL_KERNEL_MUL: for (size_t i = 0; i < n; ++i) dst[i] = a[i] * b[i]; break;
+		case VNL_KERNEL_DIV: for (size_t i = 0; i < n; ++i) dst[i] = a[i] / b[i]; break;
+		case VNL_KERNEL_MOD: for (size_t i = 0; i < n; ++i) dst[i] = fmod(a[i], b[i]); break;
+	}
+}
+
+static void scalar_vs(Vnl_KernelOp op, double *dst, const double *a, double b, size_t n) {
+	switch (op) {
+		case VNL_KERNEL_ADD: for (size_t i = 0; i < n; ++i) dst[i] = a[i] + b; break;
+		case VNL_KERNEL_SUB: for (size_t i = 0; i < n; ++i) dst[i] = a[i] - b; break;
+		case VNL_KERNEL_MUL: for (size_t i = 0; i < n; ++i) dst[i] = a[i] * b; break;
+		case VNL_KERNEL_DIV: for (size_t i = 0; i < n; ++i) dst[i] = a[i] / b; break;
+		case VNL_KERNEL_MOD: for (size_t i = 0; i < n; ++i) dst[i] = fmod(a[i], b); break;
+	}
+}
+
+static void scalar_sv(Vnl_KernelOp op, double *dst, double a, const double *b, size_t n) {
+	switch (op) {
+		case VNL_KERNEL_ADD: for (size_t i = 0; i < n; ++i) dst[i] = a + b[i]; break;
+		case VNL_KERNEL_SUB: for (size_t i = 0; i < n; ++i) dst[i] = a - b[i]; break;
+		case VNL_KERNEL_MUL: for (size_t i = 0; i < n; ++i) dst[i] = a * b[i]; break;
+		case VNL_KERNEL_DIV: for (size_t i = 0; i < n; ++i) dst[i] = a / b[i]; break;
+		case VNL_KERNEL_MOD: for (size_t i = 0; i < n; ++i) dst[i] = fmod(a, b[i]); break;
+	}
+}
+
+
+#ifdef VNL_KERNELS_X86
+
+// Stamps out the three kernels for one instruction set. Each op gets its own loop, so
+// the op is only dispatched once per call; unaligned loads and stores let the kernels
+// run on any buffer.
+#define SIMD_LOOP(width, expr) \
+	for (; i + (width) <= n; i += (width)) expr
+
+#define DEFINE_SIMD_KERNELS(isa, target, vec, width, loadu, storeu, set1, add, sub, mul, div) \
+	target static void isa##_vv(Vnl_KernelOp op, double *dst, const double *a, const double *b, size_t n) { \
+		size_t i = 0; \
+		switch (op) { \
+			case VNL_KERNEL_ADD: SIMD_LOOP(width, storeu(dst + i, add(loadu(a + i), loadu(b + i)))); break; \
+			case VNL_KERNEL_SUB: SIMD_LOOP(width, storeu(dst + i, sub(loadu(a + i), loadu(b + i)))); break; \
+			case VNL_KERNEL_MUL: SIMD_LOOP(width, storeu(dst + i, mul(loadu(a + i), loadu(b + i)))); break; \
+			case VNL_KERNEL_DIV: SIMD_LOOP(width, storeu(dst + i, div(loadu(a + i), loadu(b + i)))); break; \
+			case VNL_KERNEL_MOD: break; \
+		} \
+		scalar_vv(op, dst + i, a + i, b + i, n - i); \
+	} \
+	target static void isa##_vs(Vnl_KernelOp op, double *dst, const double *a, double b, size_t n) { \
+		size_t i = 0; \
+		vec vb = set1(b); \
+		switch (op) { \
+			case VNL_KERNEL_ADD: SIMD_LOOP(width, storeu(dst + i, add(loadu(a + i), vb))); break; \
+			case VNL_KERNEL_SUB: SIMD_LOOP(width, storeu(dst + i, sub(loadu(a + i), vb))); break; \
+			case VNL_KERNEL_MUL: SIMD_LOOP(width, storeu(dst + i, mul(loadu(a + i), vb))); break; \
+			case VNL_KERNEL_DIV: SIMD_LOOP(width, storeu(dst + i, div(loadu(a + i), vb))); break; \
+			case VNL_KERNEL_MOD: break; \
+		} \
+		scalar_vs(op, dst + i, a + i, b, n - i); \
+	} \
+	target static void isa##_sv(Vnl_KernelOp op, double *dst, double a, const double *b, size_t n) { \
+		size_t i = 0; \
+		vec va = set1(a); \
+		switch (op) { \
+			case VNL_KERNEL_ADD: SIMD_LOOP(width, storeu(dst + i, add(va, loadu(b + i)))); break; \
+			case VNL_KERNEL_SUB: SIMD_LOOP(width, storeu(dst + i, sub(va, loadu(b + i)))); break; \
+			case VNL_KERNEL_MUL: SIMD_LOOP(width, storeu(dst + i, mul(va, loadu(b + i)))); break; \
+			case VNL_KERNEL_DIV: SIMD_LOOP(width, storeu(dst + i, div(va, loadu(b + i)))); break; \
+			case VNL_KERNEL_MOD: break; \
+		} \
+		scalar_sv(op, dst + i, a, b + i, n - i); \
+	}
+
+// SSE2 is part of x86-64, so it needs no target attribute.
+DEFINE_SIMD_KERNELS(sse2, , __m128d, 2,
+	_mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_add_pd, _mm_sub_pd, _mm_mul_pd, _mm_div_pd)
+DEFINE_SIMD_KERNELS(avx2, __attribute__((target("avx2"))), __m256d, 4,
+	_mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_div_pd)
+DEFINE_SIMD_KERNELS(avx512, __attribute__((target("avx512f"))), __m512d, 8,
+	_mm512_loadu_pd, _mm512_storeu_pd, _mm512_set1_pd, _mm512_add_pd, _mm512_sub_pd, _mm512_mul_pd, _mm512_div_pd)
+
+#undef DEFINE_SIMD_KERNELS
+#undef SIMD_LOOP
+
+static const Vnl_KernelSet KERNEL_SETS[] = {
+	[VNL_ISA_SCALAR] = { scalar_vv, scalar_vs, scalar_sv },
+	[VNL_ISA_SSE2]   = { sse2_vv, sse2_vs, sse2_sv },
+	[VNL_ISA_AVX2]   = { avx2_vv, avx2_vs, avx2_sv },
+	[VNL_ISA_AVX512] = { avx512_vv, avx512_vs, avx512_sv },
+};
+
+// __builtin_cpu_supports reads CPUID, and for AVX also checks that the OS saves the
+// wider registers.
+static Vnl_KernelIsa kernel_detect_isa() {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return VNL_ISA_AVX512;
+	if (__builtin_cpu_supports("avx2")) return VNL_ISA_AVX2;
+	return VNL_ISA_SSE2;
+}
+
+#else
+
+static const Vnl_KernelSet KERNEL_SETS[] = {
+	[VNL_ISA_SCALAR] = { scalar_vv, scalar_vs, scalar_sv },
+};
+
+static Vnl_KernelIsa kernel_detect_isa() {
+	return VNL_ISA_SCALAR;
+}
+
+#endif
+
+
+// -1 until the CPU has been probed. Atomic, since the first kernel call may come from
+// several pool threads at once; they all find the same answer.
+static _Atomic int SUPPORTED_ISA = -1;
+
+static Vnl_KernelIsa kernel_supported_isa() {
+	int isa = atomic_load_explicit(&SUPPORTED_ISA, memory_order_relaxed);
+	if (isa < 0) {
+		isa = kernel_detect_isa();
+		atomic_store_explicit(&SUPPORTED_ISA, isa, memory_order_relaxed);
+	}
+	return isa;
+}
+
+static const Vnl_KernelSet *kernel_set(Vnl_KernelIsa limit) {
+	Vnl_KernelIsa supported = kernel_supported_isa();
+	return &KERNEL_SETS[limit < supported ? limit : supported];
+}
+
+Vnl_KernelIsa vnl_kernel_isa() {
+	return kernel_supported_isa();
+}
+
+const char *vnl_kernel_isa_name(Vnl_KernelIsa isa) {
+	static const char *const NAMES[] = {
+		[VNL_ISA_SCALAR] = "scalar",
+		[VNL_ISA_SSE2] = "sse2",
+		[VNL_ISA_AVX2] = "avx2",
+		[VNL_ISA_AVX512] = "avx512",
+	};
+	return NAMES[isa];
+}
+
+
+void vnl_kernel_vv(Vnl_KernelIsa isa, Vnl_KernelOp op, double *dst, const double *a, const double *b, size_t n) {
+	kernel_set(isa)->vv(op, dst, a, b, n);
+}
+
+void vnl_kernel_vs(Vnl_KernelIsa isa, Vnl_KernelOp op, double *dst, const double *a, double b, size_t n) {
+	kernel_set(isa)->vs(op, dst, a, b, n);
+}
+
+void vnl_kernel_sv(Vnl_KernelIsa isa, Vnl_KernelOp op, double *dst, double a, const double *b, size_t n) {
+	kernel_set(isa)->sv(op, dst, a, b, n);
+}
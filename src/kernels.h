@@ -0,0 +1,42 @@
+#ifndef __VINYL_KERNELS_H__
+#define __VINYL_KERNELS_H__
+
+#include <stddef.h>
+
+
+typedef enum Vnl_KernelOp Vnl_KernelOp;
+typedef enum Vnl_KernelIsa Vnl_KernelIsa;
+
+enum Vnl_KernelOp {
+	VNL_KERNEL_ADD,
+	VNL_KERNEL_SUB,
+	VNL_KERNEL_MUL,
+	VNL_KERNEL_DIV,
+	VNL_KERNEL_MOD,
+};
+
+// Instruction sets the kernels are built for, in increasing order.
+enum Vnl_KernelIsa {
+	VNL_ISA_SCALAR,
+	VNL_ISA_SSE2,
+	VNL_ISA_AVX2,
+	VNL_ISA_AVX512,
+};
+
+
+// Element-wise `dst[i] = a[i] op b[i]`, with a scalar standing in for either side in the
+// _vs/_sv forms. Results are bit for bit those of the C operators (fmod for MOD) whatever
+// the instruction set. `dst` may be the same buffer as an operand, but must not overlap
+// it otherwise. The kernels use the best instruction set the CPU supports up to `isa`,
+// so callers can cap it without affecting anyone else, e.g. to compare against the
+// scalar loops.
+void vnl_kernel_vv(Vnl_KernelIsa isa, Vnl_KernelOp, double *dst, const double *a, const double *b, size_t n);
+void vnl_kernel_vs(Vnl_KernelIsa isa, Vnl_KernelOp, double *dst, const double *a, double b, size_t n);
+void vnl_kernel_sv(Vnl_KernelIsa isa, Vnl_KernelOp, double *dst, double a, const double *b, size_t n);
+
+// The best instruction set the CPU supports, probed on first use.
+Vnl_KernelIsa vnl_kernel_isa();
+const char *vnl_kernel_isa_name(Vnl_KernelIsa);
+
+
+#endif // __VINYL_KERNELS_H__
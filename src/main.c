@@ -29,7 +29,84 @@ void console_read(Vnl_StringBuffer *buffer) {
 
 
 
-int main() {
+bool read_file(Vnl_CString path, Vnl_StringBuffer *buffer) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return false;
+    }
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+        vnl_strbuf_append_s(buffer, (Vnl_String){ chunk, n });
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+// `--emit-c script.vnl out.c` compiles a script ahead of time instead of starting the REPL.
+int emit_c(Vnl_CString inpath, Vnl_CString outpath) {
+    Vnl_StringBuffer source = {};
+    if (!read_file(inpath, &source)) {
+        printf("\e[31mError: cannot read %s\e[0m\n", inpath);
+        return 1;
+    }
+    FILE *out = fopen(outpath, "w");
+    if (!out) {
+        printf("\e[31mError: cannot write %s\e[0m\n", outpath);
+        vnl_strbuf_free(&source);
+        return 1;
+    }
+
+    Vnl_Executor *exec = vnl_exec_new();
+    bool failed = vnl_exec_emit_c(exec, vnl_string_from_b(&source), out);
+    vnl_exec_free(exec);
+    fclose(out);
+    vnl_strbuf_free(&source);
+    if (failed) {
+        remove(outpath);
+    }
+    return failed;
+}
+
+
+// `script.vnl` runs a script line by line, echoing each statement like the REPL prompt.
+// Used to run the workloads in bench/.
+int run_script(Vnl_CString path) {
+    Vnl_StringBuffer source = {};
+    if (!read_file(path, &source)) {
+        printf("\e[31mError: cannot read %s\e[0m\n", path);
+        return 1;
+    }
+
+    Vnl_Executor *exec = vnl_exec_new();
+    Vnl_String rest = vnl_string_from_b(&source);
+    while (rest.len) {
+        const char *eol = memchr(rest.chars, '\n', rest.len);
+        size_t linelen = eol ? (size_t)(eol - rest.chars) : rest.len;
+        Vnl_String line = vnl_string_trim((Vnl_String){ rest.chars, linelen });
+        rest = vnl_string_lshiftn(rest, linelen);
+        rest = vnl_string_lshift(rest);
+        if (line.len == 0) {
+            continue;
+        }
+        printf("\e[34m>>\e[0m %.*s\n", (int)line.len, line.chars);
+        vnl_exec_string(exec, line);
+    }
+    vnl_exec_free(exec);
+    vnl_strbuf_free(&source);
+    return 0;
+}
+
+
+int main(int argc, char **argv) {
+    if (argc == 4 && strcmp(argv[1], "--emit-c") == 0) {
+        return emit_c(argv[2], argv[3]);
+    }
+    if (argc == 2) {
+        return run_script(argv[1]);
+    }
+
     Vnl_StringBuffer linebuf = {};
     Vnl_Executor *exec = vnl_exec_new();
     using_history();
@@ -1,46 +1,296 @@
 
 #include "object.h"
 #include "common.h"
+#include "pool.h"
 #include "string.h"
+#include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 
-void *vnl_object_create(size_t objsize, Vnl_ObjectType type) {
-	Vnl_Object *obj = vnl_malloc(objsize);
+static const size_t ROPE_FLAT_THRESHOLD = 64;
+
+static_assert(sizeof(Vnl_F64ArrayObject) == sizeof(Vnl_ArrayObject), "f64 arrays are generalized in place");
+static_assert(sizeof(double) == sizeof(Vnl_Value), "f64 arrays are generalized in place");
+
+
+static void vnl_strobj_drop_contents(Vnl_StringObject *self) {
+	switch (self->kind) {
+		case VNL_STRKIND_FLAT: {
+			vnl_strbuf_free(&self->value);
+		} break;
+		case VNL_STRKIND_CONCAT: {
+			vnl_object_release((Vnl_Object *)self->concat.left);
+			vnl_object_release((Vnl_Object *)self->concat.right);
+		} break;
+		case VNL_STRKIND_REPEAT: {
+			vnl_object_release((Vnl_Object *)self->repeat.child);
+		} break;
+	}
+}
+
+void *vnl_object_create(Vnl_ObjectPool *pool, size_t objsize, Vnl_ObjectType type) {
+	Vnl_Object *obj = vnl_objpool_alloc(pool, objsize);
+	memset(obj, 0, objsize);
 	*obj = VNL_OBJECT_HEAD_INIT(type);
+	Vnl_Heap *heap = vnl_heap_current();
+	if (heap) {
+		heap->objects_by_type[type]++;
+	}
 	return obj;
 }
 
+// Dead objects are queued on their pool instead of being torn down recursively: releasing
+// children only queues them too, so neither deep nesting nor huge arrays grow the C stack.
+// In incremental mode the queue is drained by the executor a bit at a time.
 void vnl_object_destroy(Vnl_Object *self) {
-	switch (self->type) {
-		case VNL_OBJTYPE_NUMBER: {
-			vnl_free(self);
-		} break;
-		case VNL_OBJTYPE_STRING: {
-			Vnl_StringObject *obj = (void *)self;
-			vnl_strbuf_free(&obj->value);
-			vnl_free(obj);
-		} break;
-		case VNL_OBJTYPE_ARRAY: {
-			Vnl_ArrayObject *obj = (void *)self;
-			for (size_t i = 0; i < obj->len; ++i) {
-				vnl_object_release(obj->items[i]);
-			}
-			vnl_free(obj->items);
-			vnl_free(obj);
-		} break;
+	Vnl_ObjectPool *pool = vnl_objpool_of(self);
+	vnl_objpool_defer(self);
+	if (!vnl_objpool_is_incremental(pool)) {
+		vnl_object_collect(pool, SIZE_MAX);
 	}
 }
 
+// Tears down queued objects until `budget` units of work are spent - one per object and
+// one per released array item. Returns the unspent budget. Destructors that release
+// more objects of the same pool only queue them, since the pool is already collecting.
+size_t vnl_object_collect(Vnl_ObjectPool *pool, size_t budget) {
+	if (vnl_objpool_is_collecting(pool)) {
+		return budget;
+	}
+	vnl_objpool_set_collecting(pool, true);
+
+	while (budget) {
+		Vnl_Object *self = vnl_objpool_take_deferred(pool);
+		if (self == nullptr) {
+			break;
+		}
+		budget--;
+
+		switch (self->type) {
+			case VNL_OBJTYPE_STRING: {
+				Vnl_StringObject *obj = (void *)self;
+				vnl_strobj_drop_contents(obj);
+				vnl_objpool_dealloc(obj);
+			} break;
+			case VNL_OBJTYPE_ARRAY: {
+				Vnl_ArrayObject *obj = (void *)self;
+				while (obj->len && budget) {
+					vnl_value_release(obj->items[--obj->len]);
+					budget--;
+				}
+				if (obj->len) {
+					// Out of budget: requeue the partially released array.
+					vnl_objpool_defer(obj);
+					break;
+				}
+				vnl_free(obj->items);
+				vnl_objpool_dealloc(obj);
+			} break;
+			case VNL_OBJTYPE_F64ARRAY: {
+				Vnl_F64ArrayObject *obj = (void *)self;
+				vnl_free(obj->items);
+				vnl_objpool_dealloc(obj);
+			} break;
+			case VNL_OBJTYPE_LAZY: {
+				Vnl_LazyObject *obj = (void *)self;
+				vnl_value_release(obj->lhs);
+				vnl_value_release(obj->rhs);
+				vnl_value_release(obj->result);
+				vnl_objpool_dealloc(obj);
+			} break;
+			case VNL_OBJTYPE_ARRAYVIEW: {
+				Vnl_ArrayViewObject *obj = (void *)self;
+				vnl_object_release(obj->base);
+				vnl_objpool_dealloc(obj);
+			} break;
+		}
+	}
+
+	vnl_objpool_set_collecting(pool, false);
+	return budget;
+}
+
 void vnl_object_acquire(Vnl_Object *self) {
 	self->refcount++;
 }
 
 void vnl_object_release(Vnl_Object *self) {
-	if (self->refcount == 0) {
+	if (self->refcount <= 1) {
 		vnl_object_destroy(self);
 	} else {
 		self->refcount--;
 	}
 }
+
+
+Vnl_StringObject *vnl_strobj_new(Vnl_ObjectPool *pool, Vnl_String str) {
+	Vnl_StringObject *obj = vnl_object_create(pool, sizeof(*obj), VNL_OBJTYPE_STRING);
+	obj->kind = VNL_STRKIND_FLAT;
+	vnl_strbuf_append_s(&obj->value, str);
+	obj->len = str.len;
+	return obj;
+}
+
+Vnl_StringObject *vnl_strobj_concat(Vnl_ObjectPool *pool, Vnl_StringObject *left, Vnl_StringObject *right) {
+	if (left->len + right->len <= ROPE_FLAT_THRESHOLD) {
+		Vnl_StringObject *obj = vnl_strobj_new(pool, vnl_strobj_flatten(left));
+		vnl_strbuf_append_s(&obj->value, vnl_strobj_flatten(right));
+		obj->len = obj->value.len;
+		return obj;
+	}
+
+	Vnl_StringObject *obj = vnl_object_create(pool, sizeof(*obj), VNL_OBJTYPE_STRING);
+	obj->kind = VNL_STRKIND_CONCAT;
+	obj->len = left->len + right->len;
+	obj->concat.left = left;
+	obj->concat.right = right;
+	vnl_object_acquire((Vnl_Object *)left);
+	vnl_object_acquire((Vnl_Object *)right);
+	return obj;
+}
+
+// The caller is responsible for `str->len * times` not overflowing.
+Vnl_StringObject *vnl_strobj_repeat(Vnl_ObjectPool *pool, Vnl_StringObject *str, size_t times) {
+	if (str->len * times <= ROPE_FLAT_THRESHOLD) {
+		Vnl_String chunk = vnl_strobj_flatten(str);
+		Vnl_StringObject *obj = vnl_strobj_new(pool, (Vnl_String){ nullptr, 0 });
+		vnl_strbuf_reserve_exact(&obj->value, chunk.len * times);
+		for (size_t i = 0; i < times; ++i) {
+			vnl_strbuf_append_s(&obj->value, chunk);
+		}
+		obj->len = obj->value.len;
+		return obj;
+	}
+
+	if (str->kind == VNL_STRKIND_REPEAT) {
+		times *= str->repeat.times;
+		str = str->repeat.child;
+	}
+
+	Vnl_StringObject *obj = vnl_object_create(pool, sizeof(*obj), VNL_OBJTYPE_STRING);
+	obj->kind = VNL_STRKIND_REPEAT;
+	obj->len = str->len * times;
+	obj->repeat.child = str;
+	obj->repeat.times = times;
+	vnl_object_acquire((Vnl_Object *)str);
+	return obj;
+}
+
+
+// Writes the bytes of a rope into `dst` (which must hold self->len bytes). Concat trees
+// are walked with an explicit stack, so deep left-leaning chains can't overflow the C stack.
+static void vnl_strobj_write(Vnl_StringObject *self, char *dst) {
+	size_t len = 0, cap = 16;
+	Vnl_StringObject **stack = vnl_malloc(cap * sizeof(*stack));
+	stack[len++] = self;
+
+	while (len) {
+		Vnl_StringObject *node = stack[--len];
+		switch (node->kind) {
+			case VNL_STRKIND_FLAT: {
+				memcpy(dst, node->value.chars, node->len);
+				dst += node->len;
+			} break;
+
+			case VNL_STRKIND_CONCAT: {
+				if (len + 2 > cap) {
+					cap *= 2;
+					stack = vnl_realloc(stack, cap * sizeof(*stack));
+				}
+				stack[len++] = node->concat.right;
+				stack[len++] = node->concat.left;
+			} break;
+
+			case VNL_STRKIND_REPEAT: {
+				// Copy the chunk once, then keep doubling the already written prefix.
+				Vnl_String chunk = vnl_strobj_flatten(node->repeat.child);
+				size_t total = node->len;
+				size_t done = chunk.len < total ? chunk.len : total;
+				memcpy(dst, chunk.chars, done);
+				while (done < total) {
+					size_t n = done < total - done ? done : total - done;
+					memcpy(dst + done, dst, n);
+					done += n;
+				}
+				dst += total;
+			} break;
+		}
+	}
+
+	vnl_free(stack);
+}
+
+Vnl_String vnl_strobj_flatten(Vnl_StringObject *self) {
+	if (self->kind != VNL_STRKIND_FLAT) {
+		Vnl_StringBuffer buf = {};
+		vnl_strbuf_reserve_exact(&buf, self->len);
+		vnl_strobj_write(self, buf.chars);
+		buf.len = self->len;
+
+		vnl_strobj_drop_contents(self);
+		self->kind = VNL_STRKIND_FLAT;
+		self->value = buf;
+	}
+	return vnl_string_from_b(&self->value);
+}
+
+// Only valid on a FLAT string nobody else references. Grows the buffer geometrically,
+// so a chain of appends to the same string costs amortized O(1) allocations.
+void vnl_strobj_append(Vnl_StringObject *self, Vnl_String str) {
+	size_t needed = self->value.len + str.len;
+	if (needed > self->value.cap) {
+		size_t grown = self->value.cap + self->value.cap / 2;
+		vnl_strbuf_reserve_exact(&self->value, grown > needed ? grown : needed);
+	}
+	vnl_strbuf_append_s(&self->value, str);
+	self->len = self->value.len;
+}
+
+
+// Items are left uninitialised.
+Vnl_F64ArrayObject *vnl_f64arr_new(Vnl_ObjectPool *pool, size_t len) {
+	Vnl_F64ArrayObject *obj = vnl_object_create(pool, sizeof(*obj), VNL_OBJTYPE_F64ARRAY);
+	obj->items = vnl_malloc(sizeof(*obj->items) * (len ? len : 1));
+	obj->len = len;
+	obj->cap = len;
+	return obj;
+}
+
+// Called before anything but a number is stored into the array.
+Vnl_ArrayObject *vnl_f64arr_generalize(Vnl_F64ArrayObject *self) {
+	for (size_t i = 0; i < self->len; ++i) {
+		Vnl_Value val = vnl_value_from_number(self->items[i]);
+		memcpy(&self->items[i], &val, sizeof(val));
+	}
+	self->__base__.type = VNL_OBJTYPE_ARRAY;
+	return (Vnl_ArrayObject *)self;
+}
+
+
+// Views of a view are made over its base, so reading an item is a single lookup.
+Vnl_ArrayViewObject *vnl_arrview_new(Vnl_ObjectPool *pool, Vnl_Object *base, size_t start, ptrdiff_t step, size_t len) {
+	if (base->type == VNL_OBJTYPE_ARRAYVIEW) {
+		const Vnl_ArrayViewObject *parent = (void *)base;
+		start = parent->start + (ptrdiff_t)start * parent->step;
+		step *= parent->step;
+		base = parent->base;
+	}
+	Vnl_ArrayViewObject *obj = vnl_object_create(pool, sizeof(*obj), VNL_OBJTYPE_ARRAYVIEW);
+	vnl_object_acquire(base);
+	obj->base = base;
+	obj->start = start;
+	obj->step = step;
+	obj->len = len;
+	return obj;
+}
+
+// The item is borrowed from the base array.
+Vnl_Value vnl_arrview_get(const Vnl_ArrayViewObject *self, size_t i) {
+	size_t index = self->start + (ptrdiff_t)i * self->step;
+	if (self->base->type == VNL_OBJTYPE_F64ARRAY) {
+		return vnl_value_from_number(((const Vnl_F64ArrayObject *)self->base)->items[index]);
+	}
+	return ((const Vnl_ArrayObject *)self->base)->items[index];
+}
@@ -1,52 +1,145 @@
 #ifndef __VINYL_OBJECT_H__
 #define __VINYL_OBJECT_H__
 
+#include "kernels.h"
+#include "pool.h"
 #include "string.h"
+#include "value.h"
 #include <stddef.h>
 
 typedef enum Vnl_ObjectType Vnl_ObjectType;
+typedef enum Vnl_StringKind Vnl_StringKind;
 typedef struct Vnl_Object Vnl_Object;
-typedef struct Vnl_NumberObject Vnl_NumberObject;
 typedef struct Vnl_StringObject Vnl_StringObject;
 typedef struct Vnl_ArrayObject Vnl_ArrayObject;
+typedef struct Vnl_F64ArrayObject Vnl_F64ArrayObject;
+typedef struct Vnl_LazyObject Vnl_LazyObject;
+typedef struct Vnl_ArrayViewObject Vnl_ArrayViewObject;
 
 enum Vnl_ObjectType {
-	VNL_OBJTYPE_NUMBER = 1,
 	VNL_OBJTYPE_STRING = 2,
 	VNL_OBJTYPE_ARRAY  = 3,
+	VNL_OBJTYPE_F64ARRAY = 4,
+	VNL_OBJTYPE_LAZY = 5,
+	VNL_OBJTYPE_ARRAYVIEW = 6,
+};
+
+enum Vnl_StringKind {
+	VNL_STRKIND_FLAT,
+	VNL_STRKIND_CONCAT,
+	VNL_STRKIND_REPEAT,
 };
 
 #define VNL_OBJECT_HEAD Vnl_Object __base__
 #define VNL_OBJECT_HEAD_INIT(type) (Vnl_Object){ .refcount = 0, .type = (type) }
 
+// While an object is queued for destruction, the pool reuses `refcount` as a list link.
 struct Vnl_Object {
 	size_t refcount;
 	Vnl_ObjectType type;
 };
 
 
-struct Vnl_NumberObject {
+// Strings are ropes: concatenation and repetition build CONCAT/REPEAT nodes which are
+// flattened into a single buffer, in place, the first time their bytes are needed.
+// `len` is valid for every kind; `value` only for FLAT strings.
+struct Vnl_StringObject {
 	VNL_OBJECT_HEAD;
-	double value;
+	Vnl_StringKind kind;
+	size_t len;
+	union {
+		Vnl_StringBuffer value;
+		struct {
+			Vnl_StringObject *left;
+			Vnl_StringObject *right;
+		} concat;
+		struct {
+			Vnl_StringObject *child;
+			size_t times;
+		} repeat;
+	};
 };
 
-struct Vnl_StringObject {
+struct Vnl_ArrayObject {
 	VNL_OBJECT_HEAD;
-	Vnl_StringBuffer value;
+	Vnl_Value *items;
+	size_t len;
+	size_t cap;
 };
 
-struct Vnl_ArrayObject {
+// An array known to hold only numbers, stored as plain doubles. It is the same size as
+// Vnl_ArrayObject and its items are the same width, so vnl_f64arr_generalize can turn it
+// into a generic array in place - every reference to it sees the change.
+struct Vnl_F64ArrayObject {
 	VNL_OBJECT_HEAD;
-	Vnl_Object **items;
+	double *items;
 	size_t len;
 	size_t cap;
 };
 
+// `lhs op rhs` on number arrays, not computed yet. Operands are numbers, number arrays
+// or further lazy operations, so a whole expression is one tree that can be evaluated in
+// a single pass; an array operand either has `len` items or is broadcast from one. Once
+// it has been, `result` holds the array and the operands are dropped. `nodes` counts the
+// lazy operations in the tree.
+struct Vnl_LazyObject {
+	VNL_OBJECT_HEAD;
+	Vnl_KernelOp op;
+	size_t len;
+	size_t nodes;
+	Vnl_Value lhs;
+	Vnl_Value rhs;
+	Vnl_Value result;
+};
 
-void *vnl_object_create(size_t, Vnl_ObjectType);
+// Items `start`, `start + step`, ... of `base`, read from its buffer instead of copied.
+// The view keeps `base` alive, so an array with views on it is never unique and is never
+// overwritten in place; arithmetic on either side writes a new array instead. `base` is
+// a generic or number array, never a view itself. `step` may be negative.
+struct Vnl_ArrayViewObject {
+	VNL_OBJECT_HEAD;
+	Vnl_Object *base;
+	size_t start;
+	ptrdiff_t step;
+	size_t len;
+};
+
+
+void *vnl_object_create(Vnl_ObjectPool *, size_t, Vnl_ObjectType);
 void vnl_object_destroy(Vnl_Object *);
+size_t vnl_object_collect(Vnl_ObjectPool *, size_t);
 void vnl_object_acquire(Vnl_Object *);
 void vnl_object_release(Vnl_Object *);
 
+Vnl_StringObject *vnl_strobj_new(Vnl_ObjectPool *, Vnl_String);
+Vnl_StringObject *vnl_strobj_concat(Vnl_ObjectPool *, Vnl_StringObject *, Vnl_StringObject *);
+Vnl_StringObject *vnl_strobj_repeat(Vnl_ObjectPool *, Vnl_StringObject *, size_t);
+Vnl_String vnl_strobj_flatten(Vnl_StringObject *);
+void vnl_strobj_append(Vnl_StringObject *, Vnl_String);
+
+Vnl_F64ArrayObject *vnl_f64arr_new(Vnl_ObjectPool *, size_t);
+Vnl_ArrayObject *vnl_f64arr_generalize(Vnl_F64ArrayObject *);
+
+Vnl_ArrayViewObject *vnl_arrview_new(Vnl_ObjectPool *, Vnl_Object *, size_t, ptrdiff_t, size_t);
+Vnl_Value vnl_arrview_get(const Vnl_ArrayViewObject *, size_t);
+
+
+static inline bool vnl_object_is_unique(const Vnl_Object *self) {
+	return self->refcount <= 1;
+}
+
+
+static inline void vnl_value_acquire(Vnl_Value val) {
+	if (vnl_value_is_object(val)) {
+		vnl_object_acquire(vnl_value_as_object(val));
+	}
+}
+
+static inline void vnl_value_release(Vnl_Value val) {
+	if (vnl_value_is_object(val)) {
+		vnl_object_release(vnl_value_as_object(val));
+	}
+}
+
 
 #endif // __VINYL_OBJECT_H__
@@ -0,0 +1,198 @@
+
+#include "pool.h"
+#include "common.h"
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+
+typedef struct Vnl_Slab Vnl_Slab;
+typedef struct Vnl_FreeSlot Vnl_FreeSlot;
+typedef struct Vnl_SizeClass Vnl_SizeClass;
+
+#define SLAB_SIZE ((size_t)16 * 1024)
+#define NUM_SIZE_CLASSES 6
+
+static const size_t SIZE_CLASSES[NUM_SIZE_CLASSES] = { 16, 32, 48, 64, 96, 128 };
+
+// Slabs are SLAB_SIZE-aligned, so the slab owning a slot (and through it the pool)
+// is found by masking the slot address - objects don't need to remember their pool.
+struct Vnl_Slab {
+	Vnl_ObjectPool *pool;
+	Vnl_Slab *next;
+	size_t class_idx;
+	size_t capacity;
+	size_t bump;
+	alignas(16) unsigned char slots[];
+};
+
+struct Vnl_FreeSlot {
+	Vnl_FreeSlot *next;
+};
+
+struct Vnl_SizeClass {
+	Vnl_Slab *slabs;
+	Vnl_FreeSlot *freelist;
+};
+
+// Dead slots that still have to be torn down are chained through their first word
+// in `deferred`, so the work list itself never allocates. `collecting` is set while the
+// list is being drained, so destructors only queue more work onto it.
+struct Vnl_ObjectPool {
+	Vnl_SizeClass classes[NUM_SIZE_CLASSES];
+	size_t live_objects;
+	size_t slabs;
+	Vnl_FreeSlot *deferred;
+	size_t deferred_count;
+	bool incremental;
+	bool collecting;
+	Vnl_Heap *heap;
+};
+
+
+Vnl_ObjectPool *vnl_objpool_new() {
+	Vnl_ObjectPool *self = vnl_malloc(sizeof(*self));
+	self->heap = vnl_heap_current();
+	return self;
+}
+
+void vnl_objpool_free(Vnl_ObjectPool *self) {
+	for (size_t i = 0; i < NUM_SIZE_CLASSES; ++i) {
+		Vnl_Slab *slab = self->classes[i].slabs;
+		while (slab) {
+			Vnl_Slab *next = slab->next;
+			free(slab);
+			vnl_heap_discharge(self->heap, SLAB_SIZE);
+			slab = next;
+		}
+	}
+	vnl_free(self);
+}
+
+
+static size_t vnl_objpool_class_of(size_t size) {
+	for (size_t i = 0; i < NUM_SIZE_CLASSES; ++i) {
+		if (size <= SIZE_CLASSES[i]) {
+			return i;
+		}
+	}
+	printf(VNL_ANSICOL_RED "Fatal error: object of %zu bytes is too large for the pool!" VNL_ANSICOL_RESET, size);
+	abort();
+}
+
+static Vnl_Slab *vnl_objpool_new_slab(Vnl_ObjectPool *self, size_t class_idx) {
+	Vnl_Slab *slab = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+	if (slab == nullptr) {
+		printf(VNL_ANSICOL_RED "Fatal error: unable to allocate slab!" VNL_ANSICOL_RESET);
+		abort();
+	}
+	*slab = (Vnl_Slab){
+		.pool = self,
+		.next = self->classes[class_idx].slabs,
+		.class_idx = class_idx,
+		.capacity = (SLAB_SIZE - sizeof(Vnl_Slab)) / SIZE_CLASSES[class_idx],
+	};
+	self->classes[class_idx].slabs = slab;
+	self->slabs++;
+	// Slabs bypass vnl_malloc (they need SLAB_SIZE alignment), so charge them by hand.
+	vnl_heap_charge(self->heap, SLAB_SIZE);
+	return slab;
+}
+
+static Vnl_Slab *vnl_objpool_slab_of(const void *ptr) {
+	return (Vnl_Slab *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+
+void *vnl_objpool_alloc(Vnl_ObjectPool *self, size_t size) {
+	size_t class_idx = vnl_objpool_class_of(size);
+	Vnl_SizeClass *sclass = &self->classes[class_idx];
+	void *ptr;
+
+	if (sclass->freelist) {
+		ptr = sclass->freelist;
+		sclass->freelist = sclass->freelist->next;
+	} else {
+		Vnl_Slab *slab = sclass->slabs;
+		if (!slab || slab->bump == slab->capacity) {
+			slab = vnl_objpool_new_slab(self, class_idx);
+		}
+		ptr = slab->slots + slab->bump * SIZE_CLASSES[class_idx];
+		slab->bump++;
+	}
+
+	self->live_objects++;
+	return ptr;
+}
+
+void vnl_objpool_dealloc(void *ptr) {
+	if (ptr == nullptr) {
+		return;
+	}
+	Vnl_Slab *slab = vnl_objpool_slab_of(ptr);
+	Vnl_ObjectPool *self = slab->pool;
+	Vnl_SizeClass *sclass = &self->classes[slab->class_idx];
+
+	Vnl_FreeSlot *slot = ptr;
+	slot->next = sclass->freelist;
+	sclass->freelist = slot;
+
+	self->live_objects--;
+}
+
+
+Vnl_ObjectPoolStats vnl_objpool_stats(const Vnl_ObjectPool *self) {
+	Vnl_ObjectPoolStats stats = {
+		.live_objects = self->live_objects,
+		.deferred_objects = self->deferred_count,
+		.slabs = self->slabs,
+		.bytes_reserved = self->slabs * SLAB_SIZE,
+	};
+	for (size_t i = 0; i < NUM_SIZE_CLASSES; ++i) {
+		for (const Vnl_Slab *slab = self->classes[i].slabs; slab; slab = slab->next) {
+			stats.slots_total += slab->capacity;
+		}
+	}
+	stats.utilisation = stats.slots_total ? (double)stats.live_objects / stats.slots_total : 0.0;
+	return stats;
+}
+
+
+void vnl_objpool_defer(void *ptr) {
+	Vnl_ObjectPool *self = vnl_objpool_slab_of(ptr)->pool;
+	Vnl_FreeSlot *slot = ptr;
+	slot->next = self->deferred;
+	self->deferred = slot;
+	self->deferred_count++;
+}
+
+void *vnl_objpool_take_deferred(Vnl_ObjectPool *self) {
+	Vnl_FreeSlot *slot = self->deferred;
+	if (slot) {
+		self->deferred = slot->next;
+		self->deferred_count--;
+	}
+	return slot;
+}
+
+void vnl_objpool_set_incremental(Vnl_ObjectPool *self, bool incremental) {
+	self->incremental = incremental;
+}
+
+bool vnl_objpool_is_incremental(const Vnl_ObjectPool *self) {
+	return self->incremental;
+}
+
+void vnl_objpool_set_collecting(Vnl_ObjectPool *self, bool collecting) {
+	self->collecting = collecting;
+}
+
+bool vnl_objpool_is_collecting(const Vnl_ObjectPool *self) {
+	return self->collecting;
+}
+
+Vnl_ObjectPool *vnl_objpool_of(const void *ptr) {
+	return vnl_objpool_slab_of(ptr)->pool;
+}
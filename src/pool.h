@@ -0,0 +1,35 @@
+#ifndef __VINYL_POOL_H__
+#define __VINYL_POOL_H__
+
+#include <stddef.h>
+
+
+typedef struct Vnl_ObjectPool Vnl_ObjectPool;
+typedef struct Vnl_ObjectPoolStats Vnl_ObjectPoolStats;
+
+struct Vnl_ObjectPoolStats {
+	size_t live_objects;
+	size_t deferred_objects;
+	size_t slabs;
+	size_t slots_total;
+	size_t bytes_reserved;
+	double utilisation;
+};
+
+
+Vnl_ObjectPool *vnl_objpool_new();
+void vnl_objpool_free(Vnl_ObjectPool *);
+void *vnl_objpool_alloc(Vnl_ObjectPool *, size_t);
+void vnl_objpool_dealloc(void *);
+Vnl_ObjectPoolStats vnl_objpool_stats(const Vnl_ObjectPool *);
+
+Vnl_ObjectPool *vnl_objpool_of(const void *);
+void vnl_objpool_defer(void *);
+void *vnl_objpool_take_deferred(Vnl_ObjectPool *);
+void vnl_objpool_set_incremental(Vnl_ObjectPool *, bool);
+bool vnl_objpool_is_incremental(const Vnl_ObjectPool *);
+void vnl_objpool_set_collecting(Vnl_ObjectPool *, bool);
+bool vnl_objpool_is_collecting(const Vnl_ObjectPool *);
+
+
+#endif // __VINYL_POOL_H__
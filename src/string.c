@@ -35,6 +35,9 @@ void vnl_strbuf_reserve_exact(Vnl_StringBuffer *self, size_t size) {
 }
 
 void vnl_strbuf_append_s(Vnl_StringBuffer *self, Vnl_String other) {
+	if (other.len == 0) {
+		return;
+	}
 	vnl_strbuf_reserve(self, other.len);
 	memcpy(self->chars + self->len, other.chars, other.len);
 	self->len += other.len;
@@ -186,7 +189,7 @@ void vnl_string_print(Vnl_String self) {
 
 void vnl_string_println(Vnl_String self) {
 	vnl_string_fprint(self, stdout);
-	fputs("", stdout);
+	fputs("\n", stdout);
 }
 
 void vnl_string_fprint(Vnl_String self, FILE *fp) {
@@ -199,7 +202,7 @@ void vnl_string_fprint(Vnl_String self, FILE *fp) {
 
 void vnl_string_fprintln(Vnl_String self, FILE *fp) {
 	vnl_string_fprint(self, fp);
-	fputs("", fp);
+	fputs("\n", fp);
 }
 
 void vnl_string_print_escaped(Vnl_String self) {
@@ -258,7 +261,7 @@ void vnl_string_fprint_escaped(Vnl_String self, FILE *fp) {
 
 void vnl_string_fprintln_escaped(Vnl_String self, FILE *fp) {
 	vnl_string_fprint_escaped(self, fp);
-	fputs("", fp);
+	fputs("\n", fp);
 }
 
 /***************************************************************************************/
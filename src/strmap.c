@@ -1,19 +1,20 @@
 
 #include "strmap.h"
 #include "common.h"
+#include "intern.h"
 #include "object.h"
 #include "string.h"
 #include <stddef.h>
 
 #include <string.h>
-#include <xxhash.h>
 
 
 typedef struct Vnl_StringMapEntry Vnl_StringMapEntry;
 
+// Keys are interned symbols: their hash is precomputed and equality is pointer identity.
 struct Vnl_StringMapEntry {
-	Vnl_FixedString key;
-	Vnl_Object *value;
+	const Vnl_Symbol *key;
+	Vnl_Value value;
 };
 
 struct Vnl_StringMap {
@@ -26,7 +27,6 @@ struct Vnl_StringMap {
 static const Vnl_StringMapEntry EMPTY_ENTRY = { 0 };
 static const size_t INITIAL_CAPACITY = 32;
 static const float LOAD_FACTOR = 0.6;
-static const size_t HASH_SEED = 0;
 
 
 Vnl_StringMap *vnl_strmap_new() {
@@ -38,12 +38,11 @@ Vnl_StringMap *vnl_strmap_new() {
 
 
 static void vnl_strmap_drop_entry(Vnl_StringMapEntry *entry) {
-	vnl_fixstr_free(&entry->key);
-	vnl_object_release(entry->value);
+	vnl_value_release(entry->value);
 }
 
 static bool vnl_strmap_is_empty_entry(const Vnl_StringMapEntry *entry) {
-	return vnl_memcmpeq(entry, &EMPTY_ENTRY, sizeof(*entry));
+	return entry->key == nullptr;
 }
 
 static void vnl_strmap_clear_entry(Vnl_StringMapEntry *entry) {
@@ -51,15 +50,13 @@ static void vnl_strmap_clear_entry(Vnl_StringMapEntry *entry) {
 }
 
 static void vnl_strmap_insert_entry_nocopy(Vnl_StringMap *self, Vnl_StringMapEntry *entry) {
-	XXH64_hash_t hash = XXH64(entry->key.chars, entry->key.len, HASH_SEED);
 	for (size_t i = 0; i < self->cap; ++i) {
-		size_t idx = (hash + i) % self->cap;
+		size_t idx = (entry->key->hash + i) % self->cap;
 		Vnl_StringMapEntry *curr_entry = &self->entries[idx];
 		if (vnl_strmap_is_empty_entry(curr_entry)) {
-			// UNSAFE: you really shouldn't use bit-by-bit copying of owning structures!
-			// It is safe here because empty entry is indicated by having 0-sized key and null value.
-			memcpy(curr_entry, entry, sizeof(*entry));
+			*curr_entry = *entry;
 			vnl_strmap_clear_entry(entry);
+			self->len++;
 			return;
 		}
 	}
@@ -73,25 +70,19 @@ static void vnl_strmap_resize(Vnl_StringMap *self) {
 		.cap = new_cap,
 	};
 
-	for (size_t i = 0; i < new_cap; ++i) {
+	for (size_t i = 0; i < self->cap; ++i) {
 		Vnl_StringMapEntry *entry = &self->entries[i];
 		if (!vnl_strmap_is_empty_entry(entry)) {
-			vnl_strmap_insert_entry_nocopy(self, entry);
+			vnl_strmap_insert_entry_nocopy(&new_self, entry);
 		}
 	}
 
-	vnl_strmap_clear(self);
 	vnl_free(self->entries);
 	*self = new_self;
 }
 
 void vnl_strmap_free(Vnl_StringMap *self) {
-	for (size_t i = 0; i < self->cap; ++i) {
-		Vnl_StringMapEntry *entry = &self->entries[i];
-		if (!vnl_strmap_is_empty_entry(entry)) {
-			vnl_strmap_drop_entry(entry);
-		}
-	}
+	vnl_strmap_clear(self);
 	vnl_free(self->entries);
 	vnl_free(self);
 }
@@ -101,62 +92,86 @@ void vnl_strmap_clear(Vnl_StringMap *self) {
 		Vnl_StringMapEntry *entry = &self->entries[i];
 		if (!vnl_strmap_is_empty_entry(entry)) {
 			vnl_strmap_drop_entry(entry);
+			vnl_strmap_clear_entry(entry);
 		}
 	}
 	self->len = 0;
 }
 
-void vnl_strmap_insert(Vnl_StringMap *self, Vnl_String key, Vnl_Object *value) {
-	if (self->len * 1.0 / self->cap >= LOAD_FACTOR) {
-		vnl_strmap_resize(self);
-	}
-	vnl_object_acquire(value);
-	Vnl_StringMapEntry entry = { vnl_fixstr_from_s(key), value };
-	vnl_strmap_insert_entry_nocopy(self, &entry);
-}
-
 
-Vnl_StringMapEntry *vnl_strmap_find_entry(Vnl_StringMap *self, Vnl_String key) {
-	XXH64_hash_t hash = XXH64(key.chars, key.len, HASH_SEED);
+static Vnl_StringMapEntry *vnl_strmap_find_entry(Vnl_StringMap *self, const Vnl_Symbol *key) {
 	for (size_t i = 0; i < self->cap; ++i) {
-		size_t idx = (hash + i) % self->cap;
+		size_t idx = (key->hash + i) % self->cap;
 		Vnl_StringMapEntry *curr_entry = &self->entries[idx];
 		if (vnl_strmap_is_empty_entry(curr_entry)) {
 			return nullptr;
 		}
-
-		Vnl_String entrykey = vnl_string_from_f(&curr_entry->key);
-		if (vnl_string_cmpeq_s(entrykey, key)) {
+		if (curr_entry->key == key) {
 			return curr_entry;
 		}
 	}
 	return nullptr;
 }
 
-Vnl_Object *vnl_strmap_pop(Vnl_StringMap *self, Vnl_String key) {
+// Re-inserts the entries following a freshly emptied slot, so that linear probing
+// chains that used to run through it stay reachable.
+static void vnl_strmap_rehash_cluster(Vnl_StringMap *self, size_t hole) {
+	for (size_t i = 1; i < self->cap; ++i) {
+		Vnl_StringMapEntry *entry = &self->entries[(hole + i) % self->cap];
+		if (vnl_strmap_is_empty_entry(entry)) {
+			return;
+		}
+		Vnl_StringMapEntry moved = *entry;
+		vnl_strmap_clear_entry(entry);
+		self->len--;
+		vnl_strmap_insert_entry_nocopy(self, &moved);
+	}
+}
+
+
+void vnl_strmap_insert(Vnl_StringMap *self, const Vnl_Symbol *key, Vnl_Value value) {
+	vnl_value_acquire(value);
+
+	Vnl_StringMapEntry *existing = vnl_strmap_find_entry(self, key);
+	if (existing) {
+		Vnl_Value old = existing->value;
+		existing->value = value;
+		vnl_value_release(old);
+		return;
+	}
+
+	if (self->len * 1.0 / self->cap >= LOAD_FACTOR) {
+		vnl_strmap_resize(self);
+	}
+	Vnl_StringMapEntry entry = { key, value };
+	vnl_strmap_insert_entry_nocopy(self, &entry);
+}
+
+// Ownership of the returned value is transferred to the caller.
+Vnl_Value vnl_strmap_pop(Vnl_StringMap *self, const Vnl_Symbol *key) {
 	Vnl_StringMapEntry *entry = vnl_strmap_find_entry(self, key);
 	if (entry) {
-		Vnl_Object *obj = entry->value;
+		Vnl_Value value = entry->value;
 		vnl_strmap_clear_entry(entry);
-		vnl_object_release(obj);
-		return obj;
+		self->len--;
+		vnl_strmap_rehash_cluster(self, entry - self->entries);
+		return value;
 	} else {
-		return nullptr;
+		return VNL_NULL;
 	}
 }
 
-Vnl_Object *vnl_strmap_find(Vnl_StringMap *self, Vnl_String key) {
+Vnl_Value vnl_strmap_find(Vnl_StringMap *self, const Vnl_Symbol *key) {
 	Vnl_StringMapEntry *entry = vnl_strmap_find_entry(self, key);
 	if (entry) {
-		Vnl_Object *obj = entry->value;
-		return obj;
+		return entry->value;
 	} else {
-		return nullptr;
+		return VNL_NULL;
 	}
 }
 
-bool vnl_strmap_contains(Vnl_StringMap *self, Vnl_String key) {
-	return vnl_strmap_find(self, key) != nullptr;
+bool vnl_strmap_contains(Vnl_StringMap *self, const Vnl_Symbol *key) {
+	return vnl_strmap_find_entry(self, key) != nullptr;
 }
 
 
@@ -168,7 +183,7 @@ void vnl_strmap_foreach(const Vnl_StringMap *self, Vnl_StringMapCallback callbac
 		}
 
 		callback(
-			vnl_string_from_f(&entry->key),
+			vnl_symbol_str(entry->key),
 			entry->value
 		);
 
@@ -0,0 +1,261 @@
+#include "threadpool.h"
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "common.h"
+
+
+// The chunks a thread still has to run, as `begin << 32 | end`. Packing both ends into one
+// word lets the owner take chunks off the front and thieves split off the back with a
+// single compare-and-swap each. Equal words always mean the same unclaimed chunks, so
+// a CAS that succeeds on a value seen earlier is still correct.
+typedef struct {
+	alignas(64) _Atomic uint64_t range;
+} Vnl_WorkQueue;
+
+#define RANGE(begin, end) (((uint64_t)(begin) << 32) | (uint64_t)(end))
+#define RANGE_BEGIN(range) ((size_t)((range) >> 32))
+#define RANGE_END(range) ((size_t)((range) & UINT32_MAX))
+
+// Chunk indices have to fit in half a word; larger jobs get larger chunks.
+static const size_t MAX_CHUNKS = UINT32_MAX;
+
+// More threads than this per CPU only add switching, and an absurd count would exhaust
+// memory or the thread limit.
+static const size_t MAX_THREADS_PER_CPU = 4;
+
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	// Serialises jobs and resizes, so several executors can share the pool.
+	pthread_mutex_t submit;
+
+	// Sized for `size` threads, caller included. Fewer workers than that may have
+	// started, if the system refused some.
+	pthread_t *workers;
+	size_t nworkers;
+	size_t size;
+	bool stopping;
+
+	// The current job. `generation` tells workers a new one is up; `active` counts the
+	// workers that haven't finished with it yet. Workers start out having seen
+	// `spawned_at`, the generation when they were created.
+	uint64_t generation;
+	uint64_t spawned_at;
+	size_t active;
+	Vnl_ParallelFn fn;
+	void *ctx;
+	size_t n;
+	size_t grain;
+	// The job runs on `nqueues` threads: workers 0 to nqueues - 2, each on the queue with
+	// its own index, and the caller on the last one. Other workers sit it out.
+	size_t nqueues;
+	Vnl_WorkQueue *queues;
+} Vnl_ThreadPool;
+
+static Vnl_ThreadPool POOL = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.wake = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+	.submit = PTHREAD_MUTEX_INITIALIZER,
+};
+
+// Set on the pool's workers, so a job started from inside a job runs inline.
+static _Thread_local bool IN_POOL = false;
+
+
+static bool queue_pop(Vnl_WorkQueue *queue, size_t *chunk) {
+	uint64_t range = atomic_load_explicit(&queue->range, memory_order_relaxed);
+	for (;;) {
+		size_t begin = RANGE_BEGIN(range), end = RANGE_END(range);
+		if (begin >= end) {
+			return false;
+		}
+		if (atomic_compare_exchange_weak(&queue->range, &range, RANGE(begin + 1, end))) {
+			*chunk = begin;
+			return true;
+		}
+	}
+}
+
+// Moves the back half of `victim`'s chunks (at least one) into `queue`, which is empty.
+static bool queue_steal(Vnl_WorkQueue *queue, Vnl_WorkQueue *victim) {
+	uint64_t range = atomic_load_explicit(&victim->range, memory_order_relaxed);
+	for (;;) {
+		size_t begin = RANGE_BEGIN(range), end = RANGE_END(range);
+		if (begin >= end) {
+			return false;
+		}
+		size_t mid = begin + (end - begin) / 2;
+		if (atomic_compare_exchange_weak(&victim->range, &range, RANGE(begin, mid))) {
+			atomic_store(&queue->range, RANGE(mid, end));
+			return true;
+		}
+	}
+}
+
+// Runs chunks until no thread has any left. Chunks a thief is still moving between queues
+// are invisible here, but that thief runs them itself.
+static void pool_run(size_t self) {
+	size_t nqueues = POOL.nqueues;
+	Vnl_WorkQueue *queue = &POOL.queues[self];
+	for (;;) {
+		size_t chunk;
+		while (queue_pop(queue, &chunk)) {
+			size_t begin = chunk * POOL.grain;
+			size_t end = begin + POOL.grain < POOL.n ? begin + POOL.grain : POOL.n;
+			POOL.fn(POOL.ctx, begin, end);
+		}
+		bool stolen = false;
+		for (size_t i = 1; i < nqueues && !stolen; ++i) {
+			stolen = queue_steal(queue, &POOL.queues[(self + i) % nqueues]);
+		}
+		if (!stolen) {
+			return;
+		}
+	}
+}
+
+static void *pool_worker(void *arg) {
+	size_t self = (size_t)arg;
+	IN_POOL = true;
+	uint64_t seen = POOL.spawned_at;
+	for (;;) {
+		pthread_mutex_lock(&POOL.lock);
+		while (!POOL.stopping && POOL.generation == seen) {
+			pthread_cond_wait(&POOL.wake, &POOL.lock);
+		}
+		if (POOL.stopping) {
+			pthread_mutex_unlock(&POOL.lock);
+			return nullptr;
+		}
+		seen = POOL.generation;
+		bool joins = self + 1 < POOL.nqueues;
+		pthread_mutex_unlock(&POOL.lock);
+		if (!joins) {
+			continue;
+		}
+
+		pool_run(self);
+
+		pthread_mutex_lock(&POOL.lock);
+		if (--POOL.active == 0) {
+			pthread_cond_signal(&POOL.done);
+		}
+		pthread_mutex_unlock(&POOL.lock);
+	}
+}
+
+static void pool_stop() {
+	pthread_mutex_lock(&POOL.lock);
+	POOL.stopping = true;
+	pthread_cond_broadcast(&POOL.wake);
+	pthread_mutex_unlock(&POOL.lock);
+	for (size_t i = 0; i < POOL.nworkers; ++i) {
+		pthread_join(POOL.workers[i], nullptr);
+	}
+	POOL.stopping = false;
+	POOL.nworkers = 0;
+}
+
+// The pool outlives every executor, so its memory comes from plain malloc rather than
+// being charged to whichever heap happens to be entered. If memory or threads run out,
+// the pool keeps what it has: jobs run on fewer threads, or inline with none.
+static void pool_resize(size_t threads) {
+	pthread_t *workers = malloc(sizeof(*workers) * (threads - 1 ? threads - 1 : 1));
+	Vnl_WorkQueue *queues = aligned_alloc(alignof(Vnl_WorkQueue), sizeof(*queues) * threads);
+	if (!workers || !queues) {
+		free(workers);
+		free(queues);
+		return;
+	}
+	pool_stop();
+	free(POOL.workers);
+	free(POOL.queues);
+	POOL.workers = workers;
+	POOL.queues = queues;
+	POOL.size = threads;
+	for (size_t i = 0; i < threads; ++i) {
+		atomic_init(&POOL.queues[i].range, 0);
+	}
+	POOL.spawned_at = POOL.generation;
+	for (size_t i = 0; i + 1 < threads; ++i) {
+		if (pthread_create(&POOL.workers[i], nullptr, pool_worker, (void *)i)) {
+			break;
+		}
+		POOL.nworkers++;
+	}
+}
+
+
+size_t vnl_threadpool_cpus() {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? cpus : 1;
+}
+
+size_t vnl_threadpool_max_threads() {
+	return MAX_THREADS_PER_CPU * vnl_threadpool_cpus();
+}
+
+void vnl_parallel_for(size_t threads, size_t n, size_t grain, Vnl_ParallelFn fn, void *ctx) {
+	grain = grain ? grain : 1;
+	if (n / MAX_CHUNKS >= grain) {
+		grain = n / MAX_CHUNKS + 1;
+	}
+	size_t nchunks = n / grain + (n % grain != 0);
+	if (nchunks <= 1 || IN_POOL) {
+		fn(ctx, 0, n);
+		return;
+	}
+
+	size_t max_threads = vnl_threadpool_max_threads();
+	threads = threads ? (threads < max_threads ? threads : max_threads) : vnl_threadpool_cpus();
+	if (threads <= 1) {
+		fn(ctx, 0, n);
+		return;
+	}
+	pthread_mutex_lock(&POOL.submit);
+	// The pool only ever grows: callers asking for fewer threads leave the rest idle.
+	if (POOL.size < threads) {
+		pool_resize(threads);
+	}
+
+	size_t nqueues = POOL.nworkers + 1 < threads ? POOL.nworkers + 1 : threads;
+	if (nqueues <= 1) {
+		pthread_mutex_unlock(&POOL.submit);
+		fn(ctx, 0, n);
+		return;
+	}
+	// Deal the chunks out in contiguous runs, so each thread starts on its own stretch
+	// of memory.
+	for (size_t i = 0; i < nqueues; ++i) {
+		atomic_store(&POOL.queues[i].range, RANGE(nchunks * i / nqueues, nchunks * (i + 1) / nqueues));
+	}
+	pthread_mutex_lock(&POOL.lock);
+	POOL.fn = fn;
+	POOL.ctx = ctx;
+	POOL.n = n;
+	POOL.grain = grain;
+	POOL.nqueues = nqueues;
+	POOL.active = nqueues - 1;
+	POOL.generation++;
+	pthread_cond_broadcast(&POOL.wake);
+	pthread_mutex_unlock(&POOL.lock);
+
+	IN_POOL = true;
+	pool_run(nqueues - 1);
+	IN_POOL = false;
+
+	pthread_mutex_lock(&POOL.lock);
+	while (POOL.active) {
+		pthread_cond_wait(&POOL.done, &POOL.lock);
+	}
+	pthread_mutex_unlock(&POOL.lock);
+	pthread_mutex_unlock(&POOL.submit);
+}
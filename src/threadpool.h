@@ -0,0 +1,26 @@
+#ifndef __VINYL_THREADPOOL_H__
+#define __VINYL_THREADPOOL_H__
+
+#include <stddef.h>
+
+
+// Called with a range of indices to process, [begin, end).
+typedef void(*Vnl_ParallelFn)(void *ctx, size_t begin, size_t end);
+
+
+// Runs `fn` over [0, n) split into chunks of `grain` indices, on `threads` threads (the
+// caller included, 0 meaning one per CPU) and returns once every chunk is done. The
+// threads besides the caller come from a process-wide pool, which grows to the largest
+// count asked for, so callers asking for different counts don't disturb each other.
+// Chunks start out evenly dealt between the threads; a thread that runs out steals half
+// of what another one has left. Work that fits in a single chunk, or a single thread,
+// runs inline. Workers have no heap entered, so `fn` must not allocate through
+// vnl_malloc.
+void vnl_parallel_for(size_t threads, size_t n, size_t grain, Vnl_ParallelFn fn, void *ctx);
+
+size_t vnl_threadpool_cpus();
+// The most threads vnl_parallel_for runs a job on; larger counts are capped to it.
+size_t vnl_threadpool_max_threads();
+
+
+#endif // __VINYL_THREADPOOL_H__
@@ -0,0 +1,70 @@
+#ifndef __VINYL_VALUE_H__
+#define __VINYL_VALUE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+typedef struct Vnl_Object Vnl_Object;
+typedef struct Vnl_Value Vnl_Value;
+
+// NaN-boxed value word. Any double is stored as-is; non-number values live in
+// the payload of a quiet NaN with bit 50 set, and heap objects additionally
+// carry the sign bit. NaNs produced by arithmetic are canonicalized on boxing so
+// they never collide with the tagged space.
+struct Vnl_Value {
+	uint64_t bits;
+};
+
+#define VNL_VALUE_SIGN_BIT  ((uint64_t)0x8000000000000000)
+#define VNL_VALUE_QNAN      ((uint64_t)0x7ffc000000000000)
+#define VNL_VALUE_CANON_NAN ((uint64_t)0x7ff8000000000000)
+#define VNL_VALUE_TAG_NULL  ((uint64_t)0x0000000000000001)
+#define VNL_VALUE_TAG_OBJ   (VNL_VALUE_SIGN_BIT | VNL_VALUE_QNAN)
+#define VNL_VALUE_PTR_MASK  ((uint64_t)0x0000ffffffffffff)
+
+#define VNL_NULL ((Vnl_Value){ VNL_VALUE_QNAN | VNL_VALUE_TAG_NULL })
+
+
+static inline Vnl_Value vnl_value_from_number(double num) {
+	Vnl_Value val;
+	memcpy(&val.bits, &num, sizeof(num));
+	if ((val.bits & VNL_VALUE_QNAN) == VNL_VALUE_QNAN) {
+		val.bits = VNL_VALUE_CANON_NAN;
+	}
+	return val;
+}
+
+static inline Vnl_Value vnl_value_from_object(Vnl_Object *obj) {
+	return (Vnl_Value){ VNL_VALUE_TAG_OBJ | ((uint64_t)(uintptr_t)obj & VNL_VALUE_PTR_MASK) };
+}
+
+static inline bool vnl_value_is_number(Vnl_Value val) {
+	return (val.bits & VNL_VALUE_QNAN) != VNL_VALUE_QNAN;
+}
+
+static inline bool vnl_value_is_object(Vnl_Value val) {
+	return (val.bits & VNL_VALUE_TAG_OBJ) == VNL_VALUE_TAG_OBJ;
+}
+
+static inline bool vnl_value_is_null(Vnl_Value val) {
+	return val.bits == VNL_NULL.bits;
+}
+
+static inline bool vnl_value_is_same(Vnl_Value a, Vnl_Value b) {
+	return a.bits == b.bits;
+}
+
+static inline double vnl_value_as_number(Vnl_Value val) {
+	double num;
+	memcpy(&num, &val.bits, sizeof(num));
+	return num;
+}
+
+static inline Vnl_Object *vnl_value_as_object(Vnl_Value val) {
+	return (Vnl_Object *)(uintptr_t)(val.bits & VNL_VALUE_PTR_MASK);
+}
+
+
+#endif // __VINYL_VALUE_H__
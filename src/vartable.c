@@ -0,0 +1,83 @@
+#include "vartable.h"
+#include "common.h"
+#include "intern.h"
+#include "object.h"
+#include "strmap.h"
+#include <stddef.h>
+
+
+static const size_t INITIAL_CAPACITY = 32;
+
+
+Vnl_VarTable *vnl_vartable_new() {
+	Vnl_VarTable *self = vnl_malloc(sizeof(*self));
+	*self = (Vnl_VarTable){
+		.slots = vnl_strmap_new(),
+		.names = vnl_malloc(sizeof(*self->names) * INITIAL_CAPACITY),
+		.values = vnl_malloc(sizeof(*self->values) * INITIAL_CAPACITY),
+		.len = 0,
+		.cap = INITIAL_CAPACITY,
+	};
+	return self;
+}
+
+void vnl_vartable_free(Vnl_VarTable *self) {
+	for (size_t i = 0; i < self->len; ++i) {
+		vnl_value_release(self->values[i]);
+	}
+	vnl_strmap_free(self->slots);
+	vnl_free(self->names);
+	vnl_free(self->values);
+	vnl_free(self);
+}
+
+// Returns the slot of `name`, creating an unset one if the name is new.
+size_t vnl_vartable_resolve(Vnl_VarTable *self, const Vnl_Symbol *name) {
+	size_t slot = vnl_vartable_lookup(self, name);
+	if (slot != VNL_VARTABLE_NOSLOT) {
+		return slot;
+	}
+
+	if (self->len == self->cap) {
+		self->cap *= 2;
+		self->names = vnl_realloc(self->names, sizeof(*self->names) * self->cap);
+		self->values = vnl_realloc(self->values, sizeof(*self->values) * self->cap);
+	}
+	slot = self->len++;
+	self->names[slot] = name;
+	self->values[slot] = VNL_NULL;
+	vnl_strmap_insert(self->slots, name, vnl_value_from_number(slot));
+	return slot;
+}
+
+size_t vnl_vartable_lookup(Vnl_VarTable *self, const Vnl_Symbol *name) {
+	Vnl_Value slot = vnl_strmap_find(self->slots, name);
+	if (vnl_value_is_null(slot)) {
+		return VNL_VARTABLE_NOSLOT;
+	}
+	return vnl_value_as_number(slot);
+}
+
+void vnl_vartable_set(Vnl_VarTable *self, size_t slot, Vnl_Value value) {
+	vnl_value_acquire(value);
+	Vnl_Value old = self->values[slot];
+	self->values[slot] = value;
+	vnl_value_release(old);
+}
+
+// Ownership of the returned value is transferred to the caller; the slot is left unset.
+Vnl_Value vnl_vartable_pop(Vnl_VarTable *self, size_t slot) {
+	Vnl_Value value = self->values[slot];
+	self->values[slot] = VNL_NULL;
+	return value;
+}
+
+
+void vnl_vartable_foreach(const Vnl_VarTable *self, Vnl_VarTableCallback callback) {
+	for (size_t i = 0; i < self->len; ++i) {
+		if (vnl_value_is_null(self->values[i])) {
+			continue;
+		}
+		callback(vnl_symbol_str(self->names[i]), self->values[i]);
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef __VINYL_VARTABLE_H__
+#define __VINYL_VARTABLE_H__
+
+#include "intern.h"
+#include "strmap.h"
+#include "string.h"
+#include "value.h"
+#include <stddef.h>
+
+
+typedef struct Vnl_VarTable Vnl_VarTable;
+
+typedef void(*Vnl_VarTableCallback)(Vnl_String, Vnl_Value);
+
+// Variables live in a flat array of slots. The compiler resolves every name to its slot
+// once, so the VM reads and writes variables by index; `slots` maps a symbol to its slot
+// number and is only consulted when resolving. A slot is never reused for another name,
+// and an unset variable holds VNL_NULL.
+struct Vnl_VarTable {
+	Vnl_StringMap *slots;
+	const Vnl_Symbol **names;
+	Vnl_Value *values;
+	size_t len;
+	size_t cap;
+};
+
+#define VNL_VARTABLE_NOSLOT ((size_t)-1)
+
+
+Vnl_VarTable *vnl_vartable_new();
+void vnl_vartable_free(Vnl_VarTable *);
+size_t vnl_vartable_resolve(Vnl_VarTable *, const Vnl_Symbol *);
+size_t vnl_vartable_lookup(Vnl_VarTable *, const Vnl_Symbol *);
+void vnl_vartable_set(Vnl_VarTable *, size_t, Vnl_Value);
+Vnl_Value vnl_vartable_pop(Vnl_VarTable *, size_t);
+
+void vnl_vartable_foreach(const Vnl_VarTable *, Vnl_VarTableCallback);
+
+
+static inline Vnl_Value vnl_vartable_get(const Vnl_VarTable *self, size_t slot) {
+	return self->values[slot];
+}
+
+
+#endif // __VINYL_VARTABLE_H__
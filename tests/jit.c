@@ -0,0 +1,117 @@
+// Differential test of the JIT against the interpreter: every statement is run on two
+// executors, one with `__jit__` on, over the same variables, and the two have to agree
+// bit for bit on the statement's value and on every variable it stores. The exception is
+// NaN: which NaN operand an operation passes on is up to the C compiler, so any NaN
+// matches any other.
+#include <math.h>
+#include <stdio.h>
+
+#include "executor.h"
+#include "jit.h"
+
+
+static const char OPS[] = { '+', '-', '*', '/', '%' };
+
+// Chains of two operators, with variables and constants on either side and results
+// both stored and left on the stack.
+static const char *const SHAPES[] = {
+	"x = a %c b %c c",
+	"x = a %c 7 %c b",
+	"a %c b %c c",
+	"x = (a %c b) %c (c - a)",
+	"y = 0.5 %c a %c c * b",
+};
+
+static size_t FAILURES = 0;
+
+static Vnl_Executor *executor_new(bool jit) {
+	Vnl_Executor *exec = vnl_exec_new();
+	vnl_exec_setvar(exec, vnl_string_from_c("__debug__"), vnl_value_from_number(0));
+	vnl_exec_setvar(exec, vnl_string_from_c("__jit__"), vnl_value_from_number(jit));
+	// Settings are read when a statement runs through vnl_exec_string.
+	vnl_exec_string(exec, vnl_string_from_c("__jit__"));
+	return exec;
+}
+
+static void set_vars(Vnl_Executor *exec, double a, double b, double c) {
+	vnl_exec_setvar(exec, vnl_string_from_c("a"), vnl_value_from_number(a));
+	vnl_exec_setvar(exec, vnl_string_from_c("b"), vnl_value_from_number(b));
+	vnl_exec_setvar(exec, vnl_string_from_c("c"), vnl_value_from_number(c));
+	vnl_exec_setvar(exec, vnl_string_from_c("x"), vnl_value_from_number(0));
+	vnl_exec_setvar(exec, vnl_string_from_c("y"), vnl_value_from_number(0));
+}
+
+static void expect_same(const char *source, const char *what, double a, double b, double c, Vnl_Value interp, Vnl_Value jit) {
+	if (vnl_value_is_same(interp, jit)) {
+		return;
+	}
+	if (vnl_value_is_number(interp) && vnl_value_is_number(jit)
+		&& isnan(vnl_value_as_number(interp)) && isnan(vnl_value_as_number(jit))) {
+		return;
+	}
+	if (FAILURES++ < 20) {
+		printf(
+			"FAIL: %s with a=%g b=%g c=%g: %s is %g (0x%016llx) interpreted, %g (0x%016llx) jitted\n",
+			source, a, b, c, what,
+			vnl_value_as_number(interp), (unsigned long long)interp.bits,
+			vnl_value_as_number(jit), (unsigned long long)jit.bits
+		);
+	}
+}
+
+static void check_statement(Vnl_Executor *interp, Vnl_Executor *jit, const char *source) {
+	static const double VALUES[] = { 3, 5, 7, 0.5, -2.5, 0, -0.0, 1e308, -4e-320, INFINITY, -INFINITY, NAN };
+	static const size_t NVALUES = sizeof(VALUES) / sizeof(*VALUES);
+
+	Vnl_Program *interp_program = vnl_exec_compile(interp, vnl_string_from_c(source));
+	Vnl_Program *jit_program = vnl_exec_compile(jit, vnl_string_from_c(source));
+	for (size_t i = 0; i < NVALUES * NVALUES * NVALUES; ++i) {
+		double a = VALUES[i % NVALUES], b = VALUES[i / NVALUES % NVALUES], c = VALUES[i / NVALUES / NVALUES];
+		Vnl_Value results[2];
+		Vnl_Executor *execs[2] = { interp, jit };
+		Vnl_Program *programs[2] = { interp_program, jit_program };
+		for (size_t k = 0; k < 2; ++k) {
+			set_vars(execs[k], a, b, c);
+			if (vnl_exec_run(execs[k], programs[k], &results[k])) {
+				printf("FAIL: %s with a=%g b=%g c=%g: runtime error\n", source, a, b, c);
+				FAILURES++;
+			}
+		}
+		expect_same(source, "the result", a, b, c, results[0], results[1]);
+		for (const char *var = "xy"; *var; ++var) {
+			Vnl_String name = { var, 1 };
+			expect_same(source, *var == 'x' ? "x" : "y", a, b, c, vnl_exec_getvar(interp, name), vnl_exec_getvar(jit, name));
+		}
+	}
+	vnl_program_free(interp_program);
+	vnl_program_free(jit_program);
+}
+
+int main() {
+	Vnl_JitOp probe = { VNL_JITOP_CONST, .num = 0 };
+	Vnl_JitCode *code = vnl_jit_compile(&probe, 1);
+	if (code == nullptr) {
+		printf("jit: not available on this platform, skipped\n");
+		return 0;
+	}
+	vnl_jit_free(code);
+
+	Vnl_Executor *interp = executor_new(false);
+	Vnl_Executor *jit = executor_new(true);
+	size_t statements = 0;
+	for (size_t s = 0; s < sizeof(SHAPES) / sizeof(*SHAPES); ++s) {
+		for (size_t i = 0; i < sizeof(OPS); ++i) {
+			for (size_t j = 0; j < sizeof(OPS); ++j) {
+				char source[64];
+				snprintf(source, sizeof(source), SHAPES[s], OPS[i], OPS[j]);
+				check_statement(interp, jit, source);
+				statements++;
+			}
+		}
+	}
+	vnl_exec_free(interp);
+	vnl_exec_free(jit);
+
+	printf("jit: %zu statements, %zu mismatches\n", statements, FAILURES);
+	return FAILURES != 0;
+}
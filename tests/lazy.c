@@ -0,0 +1,183 @@
+// Differential test of fused array arithmetic. Random expression trees over number arrays,
+// views and broadcast operands run as one statement, which builds a lazy tree and
+// evaluates it in a single pass. They run again with one operation per statement, which
+// stores, and so forces, every intermediate. The fused statement runs with every
+// combination of `__optimize__` and `__regvm__`, and once split over the thread pool.
+// Results have to agree bit for bit, except that any NaN matches any other.
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "executor.h"
+
+
+// Not a multiple of the 512-item fuse chunk or of the pool's grain, so both leave a tail.
+#define N 40000
+#define TREES 150
+#define MAX_DEPTH 5
+#define MAX_SOURCE 8192
+
+static const char OPS[] = { '+', '-', '*', '/', '%' };
+
+// a, b and c have N items and d has 2N, so each view of d below has N items too. The
+// broadcast operands are a number, a number variable, a one-item array and a one-item
+// view.
+static const char *const LEAVES[] = {
+	"a", "b", "c", "d[::2]", "d[1::2]", "d[::0-2]", "d[5:40005]",
+	"2.5", "k", "s", "d[7:8]",
+};
+
+// Settings of the fused executors.
+static const char *const VARIANTS[] = {
+	"__optimize__ = 0",
+	"__optimize__ = 1",
+	"__optimize__ = 0, __regvm__ = 1",
+	"__optimize__ = 1, __regvm__ = 1",
+	"__parallel_threshold__ = 1000, __threads__ = 4",
+};
+#define NVARIANTS (sizeof(VARIANTS) / sizeof(*VARIANTS))
+
+static size_t FAILURES = 0;
+static uint64_t SEED = 0x9e3779b97f4a7c15;
+
+static size_t rand_below(size_t n) {
+	SEED = SEED * 6364136223846793005u + 1442695040888963407u;
+	return (SEED >> 33) % n;
+}
+
+// Mostly ordinary numbers, with zeros of both signs, a subnormal, huge values, infinities
+// and NaN mixed in.
+static double input_item(size_t i, size_t salt) {
+	static const double SPECIAL[] = { 0, -0.0, 1, -1, 1e308, -4e-320, INFINITY, -INFINITY, NAN };
+	size_t h = (i * 2654435761u + salt * 40503u) % 500;
+	if (h < sizeof(SPECIAL) / sizeof(*SPECIAL)) {
+		return SPECIAL[h];
+	}
+	return ((double)h - 250) / 7;
+}
+
+static void set_array(Vnl_Executor *exec, const char *name, size_t len, size_t salt) {
+	static Vnl_Value items[2 * N];
+	for (size_t i = 0; i < len; ++i) {
+		items[i] = vnl_value_from_number(input_item(i, salt));
+	}
+	Vnl_Value arr = vnl_aot_array(exec, items, len);
+	vnl_exec_setvar(exec, vnl_string_from_c(name), arr);
+	vnl_value_release(arr);
+}
+
+static Vnl_Executor *executor_new(const char *settings) {
+	Vnl_Executor *exec = vnl_exec_new();
+	vnl_exec_setvar(exec, vnl_string_from_c("__debug__"), vnl_value_from_number(0));
+	set_array(exec, "a", N, 1);
+	set_array(exec, "b", N, 2);
+	set_array(exec, "c", N, 3);
+	set_array(exec, "d", 2 * N, 4);
+	set_array(exec, "s", 1, 5);
+	vnl_exec_setvar(exec, vnl_string_from_c("k"), vnl_value_from_number(-0.75));
+	// Settings are read when a statement runs through vnl_exec_string.
+	char source[128];
+	snprintf(source, sizeof(source), "[%s]", settings);
+	vnl_exec_string(exec, vnl_string_from_c(source));
+	return exec;
+}
+
+static bool run(Vnl_Executor *exec, const char *source) {
+	Vnl_Program *program = vnl_exec_compile(exec, vnl_string_from_c(source));
+	bool failed = program == nullptr || vnl_exec_run(exec, program, nullptr);
+	if (program) {
+		vnl_program_free(program);
+	}
+	if (failed) {
+		printf("FAIL: %s: error\n", source);
+		FAILURES++;
+	}
+	return failed;
+}
+
+// Appends a random operation to `fused` as one expression, and the statements computing
+// it one operation at a time to `forced`. `name` receives what holds its value there: a
+// temporary `tN`.
+static void build_op(size_t depth, char *fused, char *forced, size_t *ntemps, char *name);
+
+static void build_operand(size_t depth, char *fused, char *forced, size_t *ntemps, char *name) {
+	if (depth == 0 || rand_below(3) == 0) {
+		const char *leaf = LEAVES[rand_below(sizeof(LEAVES) / sizeof(*LEAVES))];
+		strcat(fused, leaf);
+		strcpy(name, leaf);
+		return;
+	}
+	strcat(fused, "(");
+	build_op(depth, fused, forced, ntemps, name);
+	strcat(fused, ")");
+}
+
+static void build_op(size_t depth, char *fused, char *forced, size_t *ntemps, char *name) {
+	char lhs[32], rhs[32];
+	char op = OPS[rand_below(sizeof(OPS))];
+	build_operand(depth - 1, fused, forced, ntemps, lhs);
+	sprintf(fused + strlen(fused), " %c ", op);
+	build_operand(depth - 1, fused, forced, ntemps, rhs);
+	sprintf(name, "t%zu", (*ntemps)++);
+	sprintf(forced + strlen(forced), "%s = %s %c %s\n", name, lhs, op, rhs);
+}
+
+static bool same_number(double x, double y) {
+	return memcmp(&x, &y, sizeof(x)) == 0 || (isnan(x) && isnan(y));
+}
+
+static void expect_same(const char *source, const char *variant, Vnl_Value forced, Vnl_Value fused) {
+	bool same;
+	if (vnl_value_is_number(forced) || vnl_value_is_number(fused)) {
+		same = vnl_value_is_number(forced) && vnl_value_is_number(fused)
+			&& same_number(vnl_value_as_number(forced), vnl_value_as_number(fused));
+	} else {
+		const Vnl_Object *a = vnl_value_as_object(forced), *b = vnl_value_as_object(fused);
+		same = a->type == VNL_OBJTYPE_F64ARRAY && b->type == VNL_OBJTYPE_F64ARRAY;
+		const Vnl_F64ArrayObject *x = (const void *)a, *y = (const void *)b;
+		same = same && x->len == y->len;
+		for (size_t i = 0; same && i < x->len; ++i) {
+			same = same_number(x->items[i], y->items[i]);
+		}
+	}
+	if (!same && FAILURES++ < 20) {
+		printf("FAIL: %s with %s: differs from evaluating one operation at a time\n", source, variant);
+	}
+}
+
+int main() {
+	Vnl_Executor *forced = executor_new("__optimize__ = 1");
+	Vnl_Executor *fused[NVARIANTS];
+	for (size_t v = 0; v < NVARIANTS; ++v) {
+		fused[v] = executor_new(VARIANTS[v]);
+	}
+
+	static char fused_source[MAX_SOURCE], forced_source[MAX_SOURCE];
+	for (size_t t = 0; t < TREES; ++t) {
+		size_t ntemps = 0;
+		char result[32];
+		strcpy(fused_source, "x = ");
+		forced_source[0] = '\0';
+		build_op(1 + rand_below(MAX_DEPTH), fused_source, forced_source, &ntemps, result);
+
+		bool failed = false;
+		for (char *line = forced_source, *eol; !failed && (eol = strchr(line, '\n')); line = eol + 1) {
+			*eol = '\0';
+			failed = run(forced, line);
+			*eol = '\n';
+		}
+		for (size_t v = 0; !failed && v < NVARIANTS; ++v) {
+			if (!run(fused[v], fused_source)) {
+				Vnl_Value want = vnl_exec_getvar(forced, vnl_string_from_c(result));
+				expect_same(fused_source, VARIANTS[v], want, vnl_exec_getvar(fused[v], vnl_string_from_c("x")));
+			}
+		}
+	}
+
+	vnl_exec_free(forced);
+	for (size_t v = 0; v < NVARIANTS; ++v) {
+		vnl_exec_free(fused[v]);
+	}
+	printf("lazy: %d trees, %zu variants, %zu mismatches\n", TREES, NVARIANTS, FAILURES);
+	return FAILURES != 0;
+}
@@ -0,0 +1,175 @@
+// Indexing and slicing: Python-style bounds, negative steps, empty slices, views of views
+// and views that outlive or alias the array they read from. Statements run in order on
+// one executor per compiler, and the stack VM and the register VM have to give every
+// variable the expected value. Assigning to an element or a slice fails to compile and
+// leaves the array as it was.
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "executor.h"
+
+
+typedef struct {
+	const char *source;
+	// Variable to check after the statement, if any.
+	const char *var;
+	// A number, `[...]` for an array, "" for anything or nullptr if the statement has to
+	// fail.
+	const char *want;
+} Case;
+
+// Negative numbers are written `0 - n`, as there is no unary minus.
+static const Case CASES[] = {
+	{ "a = [0, 1, 2, 3, 4, 5, 6, 7, 8, 9]", "a", "[0 1 2 3 4 5 6 7 8 9]" },
+
+	// Indices count from the end when negative and have to be in range.
+	{ "x = a[0]", "x", "0" },
+	{ "x = a[0 - 1]", "x", "9" },
+	{ "x = a[0 - 10]", "x", "0" },
+	{ "x = a[10]", nullptr, nullptr },
+	{ "x = a[0 - 11]", nullptr, nullptr },
+	{ "x = a[1.5]", nullptr, nullptr },
+
+	// Slice bounds are clamped like Python's.
+	{ "x = a[2:5]", "x", "[2 3 4]" },
+	{ "x = a[0 - 3:]", "x", "[7 8 9]" },
+	{ "x = a[:0 - 7]", "x", "[0 1 2]" },
+	{ "x = a[0 - 100:3]", "x", "[0 1 2]" },
+	{ "x = a[5:100]", "x", "[5 6 7 8 9]" },
+	{ "x = a[:]", "x", "[0 1 2 3 4 5 6 7 8 9]" },
+	{ "x = a[1:8:3]", "x", "[1 4 7]" },
+	{ "x = a[1.5:3]", nullptr, nullptr },
+
+	// Negative steps start from the end and clamp the other way around.
+	{ "x = a[::0 - 1]", "x", "[9 8 7 6 5 4 3 2 1 0]" },
+	{ "x = a[::0 - 3]", "x", "[9 6 3 0]" },
+	{ "x = a[8:2:0 - 2]", "x", "[8 6 4]" },
+	{ "x = a[100:0 - 100:0 - 4]", "x", "[9 5 1]" },
+	{ "x = a[::0]", nullptr, nullptr },
+
+	// Empty slices.
+	{ "x = a[3:3]", "x", "[]" },
+	{ "x = a[5:2]", "x", "[]" },
+	{ "x = a[100:]", "x", "[]" },
+	{ "x = a[2:5:0 - 1]", "x", "[]" },
+	{ "x = a[3:3][::0 - 1]", "x", "[]" },
+	{ "x = a[3:3] + 1", "x", "[]" },
+
+	// Views of views compose into one view of the array.
+	{ "x = a[::2][::0 - 1]", "x", "[8 6 4 2 0]" },
+	{ "x = a[1:][1:][1:]", "x", "[3 4 5 6 7 8 9]" },
+	{ "x = a[::0 - 1][2:5]", "x", "[7 6 5]" },
+	{ "x = a[::0 - 1][0 - 1]", "x", "0" },
+	{ "m = [1, \"x\", 3, \"y\", 5]", "m", "" },
+	{ "x = m[::0 - 2]", "x", "[5 3 1]" },
+
+	// A view keeps reading the array it was taken from, even once the variable moves on
+	// to a new array, and an array with views on it is never overwritten in place.
+	{ "v = a[::2]", "v", "[0 2 4 6 8]" },
+	{ "a = a * 2", "a", "[0 2 4 6 8 10 12 14 16 18]" },
+	{ "v", "v", "[0 2 4 6 8]" },
+	{ "a = a + a[::0 - 1]", "a", "[18 18 18 18 18 18 18 18 18 18]" },
+	{ "r = a[::0 - 1]", "r", "[18 18 18 18 18 18 18 18 18 18]" },
+	{ "a = [0, 1, 2, 3]", "a", "[0 1 2 3]" },
+	{ "a = a - a[::0 - 1]", "a", "[-3 -1 1 3]" },
+	{ "w = a[1:]", "w", "[-1 1 3]" },
+	{ "a = a * a", "a", "[9 1 1 9]" },
+	{ "w", "w", "[-1 1 3]" },
+	{ "a = 0", "a", "0" },
+	{ "w = w + w[0]", "w", "[-2 0 2]" },
+	{ "v", "v", "[0 2 4 6 8]" },
+
+	// Elements and slices can't be assigned to, and the statement changes nothing.
+	{ "b = [1, 2, 3]", "b", "[1 2 3]" },
+	{ "b[0] = 5", nullptr, nullptr },
+	{ "b[0:2] = [5, 6]", nullptr, nullptr },
+	{ "b[::0 - 1] = b", nullptr, nullptr },
+	{ "b", "b", "[1 2 3]" },
+};
+
+static size_t FAILURES = 0;
+
+// Item `i` of a stored array. Arithmetic stores its result, so no lazy values show up.
+static bool item_at(Vnl_Value val, size_t i, double *item) {
+	const Vnl_Object *obj = vnl_value_as_object(val);
+	Vnl_Value v;
+	switch (obj->type) {
+		case VNL_OBJTYPE_F64ARRAY:
+			*item = ((const Vnl_F64ArrayObject *)obj)->items[i];
+			return true;
+		case VNL_OBJTYPE_ARRAY:
+			v = ((const Vnl_ArrayObject *)obj)->items[i];
+			break;
+		case VNL_OBJTYPE_ARRAYVIEW:
+			v = vnl_arrview_get((const Vnl_ArrayViewObject *)obj, i);
+			break;
+		default:
+			return false;
+	}
+	*item = vnl_value_as_number(v);
+	return vnl_value_is_number(v);
+}
+
+static size_t array_len(Vnl_Value val) {
+	const Vnl_Object *obj = vnl_value_as_object(val);
+	switch (obj->type) {
+		case VNL_OBJTYPE_F64ARRAY: return ((const Vnl_F64ArrayObject *)obj)->len;
+		case VNL_OBJTYPE_ARRAY: return ((const Vnl_ArrayObject *)obj)->len;
+		case VNL_OBJTYPE_ARRAYVIEW: return ((const Vnl_ArrayViewObject *)obj)->len;
+		default: return SIZE_MAX;
+	}
+}
+
+static bool matches(Vnl_Value val, const char *want) {
+	char *end;
+	if (*want == '\0') {
+		return true;
+	}
+	if (*want != '[') {
+		return vnl_value_is_number(val) && vnl_value_as_number(val) == strtod(want, &end);
+	}
+	if (!vnl_value_is_object(val)) {
+		return false;
+	}
+	size_t len = array_len(val), i = 0;
+	for (const char *p = want + 1; *p != ']'; p = end, ++i) {
+		double want_item = strtod(p, &end), item;
+		if (i >= len || !item_at(val, i, &item) || item != want_item) {
+			return false;
+		}
+	}
+	return i == len;
+}
+
+static void check(Vnl_Executor *exec, const char *vm, const Case *c) {
+	Vnl_Program *program = vnl_exec_compile(exec, vnl_string_from_c(c->source));
+	bool failed = program == nullptr || vnl_exec_run(exec, program, nullptr);
+	vnl_program_free(program);
+	if (failed != (c->want == nullptr)) {
+		printf("FAIL: %s on the %s: %s\n", c->source, vm, failed ? "error" : "expected an error");
+		FAILURES++;
+	} else if (c->var && !matches(vnl_exec_getvar(exec, vnl_string_from_c(c->var)), c->want)) {
+		printf("FAIL: %s on the %s: %s is not %s\n", c->source, vm, c->var, c->want);
+		FAILURES++;
+	}
+}
+
+int main() {
+	static const char *const VMS[] = { "stack VM", "register VM" };
+	size_t statements = 0;
+	for (size_t regvm = 0; regvm < 2; ++regvm) {
+		Vnl_Executor *exec = vnl_exec_new();
+		vnl_exec_setvar(exec, vnl_string_from_c("__debug__"), vnl_value_from_number(0));
+		vnl_exec_setvar(exec, vnl_string_from_c("__regvm__"), vnl_value_from_number(regvm));
+		// Settings are read when a statement runs through vnl_exec_string.
+		vnl_exec_string(exec, vnl_string_from_c("__regvm__"));
+		for (size_t i = 0; i < sizeof(CASES) / sizeof(*CASES); ++i) {
+			check(exec, VMS[regvm], &CASES[i]);
+			statements++;
+		}
+		vnl_exec_free(exec);
+	}
+
+	printf("slice: %zu statements, %zu mismatches\n", statements, FAILURES);
+	return FAILURES != 0;
+}